@@ -0,0 +1,265 @@
+// Headless benchmarks for the MinSh core: grid, VT parsing, layout, frame
+// composition, the lexer and read's matcher. Nothing here needs a console.
+//
+// Build: cmake --build build --target minsh-bench
+// Run:   bin/minsh-bench [workload-filter]
+
+#include "Panes.hpp"
+#include "Multiplex.hpp"
+#include "Renderer.hpp"
+#include "Lexer.hpp"
+#include "Matcher.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+// ---- Allocation counting ----
+
+static unsigned long long allocationCount = 0;
+
+// GCC inlines these deletes into callers, sees free() on memory from
+// operator new and warns; both sides are ours and use malloc/free, so the
+// pair does match.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size) {
+    allocationCount++;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    allocationCount++;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+// ---- Harness ----
+
+struct Result {
+    const char* name;
+    unsigned long long ops;
+    unsigned long long bytes; // Input consumed, 0 when MB/s does not apply
+    double seconds;
+    unsigned long long allocations;
+};
+
+std::vector<Result> results;
+const char* filter = nullptr;
+
+bool selected(const char* name) {
+    return !filter || std::string(name).find(filter) != std::string::npos;
+}
+
+// Runs op(i) for i in [0, ops) and records time and allocations. Setup
+// belongs outside op so it is not measured.
+template <class Op>
+void measure(const char* name, unsigned long long ops, unsigned long long bytesPerOp, Op op) {
+    unsigned long long allocsBefore = allocationCount;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long i = 0; i < ops; ++i) op(i);
+    auto end = std::chrono::steady_clock::now();
+
+    Result r;
+    r.name = name;
+    r.ops = ops;
+    r.bytes = ops * bytesPerOp;
+    r.seconds = std::chrono::duration<double>(end - start).count();
+    r.allocations = allocationCount - allocsBefore;
+    results.push_back(r);
+}
+
+void report() {
+    std::printf("%-16s %10s %10s %12s %11s\n", "workload", "ops", "MB/s", "ns/op", "allocs/op");
+    for (const Result& r : results) {
+        char mbs[32] = "-";
+        if (r.bytes) std::snprintf(mbs, sizeof(mbs), "%.1f", r.bytes / 1e6 / r.seconds);
+        std::printf("%-16s %10llu %10s %12.1f %11.3f\n", r.name, r.ops, mbs,
+                    r.seconds * 1e9 / r.ops, (double)r.allocations / r.ops);
+    }
+}
+
+// ---- Input generators (fixed seeds, so every run sees the same bytes) ----
+
+const char* WORDS[] = {
+    "error", "warning", "src/Panes.cpp", "note:", "build", "42", "request", "GET", "/index.html",
+    "200", "connection", "timeout", "0x7ffd", "user", "session", "--verbose", "ok", "done"
+};
+const int WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+// Plain log lines, like `cat` of a large log file.
+std::string makeLogText(size_t size, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::string out;
+    while (out.size() < size) {
+        int words = 4 + rng() % 14;
+        for (int i = 0; i < words; ++i) {
+            if (i) out += ' ';
+            out += WORDS[rng() % WORD_COUNT];
+        }
+        out += "\r\n";
+    }
+    out.resize(size);
+    return out;
+}
+
+// Compiler diagnostics and `ls --color` style output: an SGR every few bytes.
+std::string makeColorText(size_t size, unsigned seed) {
+    static const char* COLORS[] = { "\033[01;34m", "\033[01;32m", "\033[1;31m", "\033[0;33m", "\033[38;5;208m", "\033[1m" };
+    std::mt19937 rng(seed);
+    std::string out;
+    while (out.size() < size) {
+        int items = 2 + rng() % 6;
+        for (int i = 0; i < items; ++i) {
+            out += COLORS[rng() % 6];
+            out += WORDS[rng() % WORD_COUNT];
+            out += "\033[0m  ";
+        }
+        out += "\r\n";
+    }
+    out.resize(size);
+    return out;
+}
+
+// Splits text into the chunk sizes a pane typically receives per poll.
+std::vector<std::string> chunk(const std::string& text, size_t size) {
+    std::vector<std::string> chunks;
+    for (size_t i = 0; i < text.size(); i += size) chunks.push_back(text.substr(i, size));
+    return chunks;
+}
+
+// ---- Workloads ----
+
+const size_t CHUNK = 4096;
+
+void benchTextFlood() {
+    if (!selected("text-flood")) return;
+    auto chunks = chunk(makeLogText(8 << 20, 1), CHUNK);
+    Pane pane(120, 40);
+    measure("text-flood", chunks.size() * 4, CHUNK, [&](unsigned long long i) {
+        pane.write(chunks[i % chunks.size()]);
+    });
+}
+
+void benchSgrFlood() {
+    if (!selected("sgr-flood")) return;
+    auto chunks = chunk(makeColorText(8 << 20, 2), CHUNK);
+    Pane pane(120, 40);
+    measure("sgr-flood", chunks.size() * 4, CHUNK, [&](unsigned long long i) {
+        pane.write(chunks[i % chunks.size()]);
+    });
+}
+
+// One short line per op, so every op scrolls a line into history.
+void benchScroll() {
+    if (!selected("scroll")) return;
+    std::string line = "scrolling line with a little bit of text in it\r\n";
+    Pane pane(120, 40);
+    measure("scroll", 1000000, line.size(), [&](unsigned long long) {
+        pane.write(line);
+    });
+}
+
+// Four panes; each op writes a line to one of them and composes a frame.
+void benchRender() {
+    if (!selected("render")) return;
+    unsigned long long emitted = 0;
+    Multiplexer mux;
+    mux.setFixedSize(200, 60);
+    mux.setRenderer(std::unique_ptr<Renderer>(new VtRenderer([&](const char*, size_t len) { emitted += len; })));
+    for (int i = 0; i < 3; ++i) mux.addPane();
+    mux.render();
+
+    auto lines = chunk(makeColorText(1 << 20, 3), 80);
+    std::vector<Pane*> panes = mux.getAllPanes();
+    measure("render", 100000, 80, [&](unsigned long long i) {
+        panes[i % panes.size()]->write(lines[i % lines.size()]);
+        mux.render();
+    });
+    std::printf("render: %.1f bytes of terminal output per frame\n", (double)emitted / 100000);
+}
+
+// Alternating screen sizes: layout, grid reflow and full frame composition.
+void benchSplitResize() {
+    if (!selected("split-resize")) return;
+    Multiplexer mux;
+    mux.setFixedSize(200, 60);
+    mux.setRenderer(std::unique_ptr<Renderer>(new VtRenderer([](const char*, size_t) {})));
+    for (int i = 0; i < 3; ++i) mux.addPane();
+    std::string text = makeLogText(256 << 10, 4);
+    for (Pane* p : mux.getAllPanes()) p->write(text);
+    mux.render();
+
+    measure("split-resize", 2000, 0, [&](unsigned long long i) {
+        if (i % 2) mux.setFixedSize(200, 60);
+        else mux.setFixedSize(150, 45);
+        mux.render();
+    });
+}
+
+void benchTokenize() {
+    if (!selected("tokenize")) return;
+    std::string line = "search \"needle in a haystack\" ./src --ignore \"build output\" -n 20 "
+                       "say 'single quoted words' and some plain words to split \"with \\\"escapes\\\" inside\"";
+    unsigned long long tokens = 0;
+    measure("tokenize", 500000, line.size(), [&](unsigned long long) {
+        tokens += Lexer::tokenize(line).size();
+    });
+    if (tokens == 0) std::printf("tokenize: no tokens\n");
+}
+
+// read -h over a log: one literal, several (Aho-Corasick), and a regex.
+void benchMatch() {
+    struct Case { const char* name; std::vector<std::string> literals; std::string regex; bool ignoreCase; };
+    const Case cases[] = {
+        { "match-literal", { "timeout" }, "", false },
+        { "match-multi", { "error", "warning", "timeout", "0x7ffd" }, "", true },
+        { "match-regex", {}, "GET /[a-z]+\\.html|[0-9]{3}", false },
+    };
+    std::string text;
+    for (const Case& c : cases) {
+        if (!selected(c.name)) continue;
+        if (text.empty()) text = makeLogText(8 << 20, 5);
+        Matcher m;
+        for (const std::string& l : c.literals) m.addLiteral(l);
+        if (!c.regex.empty()) m.addRegex(c.regex);
+        m.setIgnoreCase(c.ignoreCase);
+        std::string error;
+        m.compile(error);
+        unsigned long long spans = 0;
+        measure(c.name, 8, text.size(), [&](unsigned long long) {
+            m.scan(text.data(), text.size(), [&](size_t, size_t) { spans++; });
+        });
+        if (spans == 0) std::printf("%s: no matches\n", c.name);
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) filter = argv[1];
+
+    benchTextFlood();
+    benchSgrFlood();
+    benchScroll();
+    benchRender();
+    benchSplitResize();
+    benchTokenize();
+    benchMatch();
+
+    report();
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "CommandCache.hpp"
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+bool CommandCache::pathLoaded = false;
+std::vector<CommandCache::Dir> CommandCache::pathDirs;
+std::unordered_map<std::string, CommandCache::Hit> CommandCache::pathHits;
+std::unordered_map<std::string, CommandCache::CmdsDir> CommandCache::cmdsDirs;
+
+namespace {
+
+// Tried in cmds/ on every platform (as before), and in PATH on Windows
+const char* EXTENSIONS[] = { "", ".exe", ".bat", ".cmd", ".com" };
+
+// cmds/ folders remembered at once; the cache starts over beyond this
+const size_t MAX_CMDS_DIRS = 64;
+
+fs::file_time_type stamp(const std::string& dir, bool& exists) {
+    std::error_code ec;
+    fs::file_time_type t = fs::last_write_time(dir, ec);
+    exists = !ec;
+    return exists ? t : fs::file_time_type();
+}
+
+bool isProgram(const fs::path& p) {
+    std::error_code ec;
+    if (!fs::is_regular_file(p, ec)) return false;
+#ifdef _WIN32
+    return true;
+#else
+    return access(p.c_str(), X_OK) == 0;
+#endif
+}
+
+}
+
+void CommandCache::loadPath() {
+    pathLoaded = true;
+    pathDirs.clear();
+    const char* env = getenv("PATH");
+    std::string path = env ? env : "";
+#ifdef _WIN32
+    const char separator = ';';
+#else
+    const char separator = ':';
+#endif
+    size_t pos = 0;
+    while (pos <= path.size()) {
+        size_t end = path.find(separator, pos);
+        if (end == std::string::npos) end = path.size();
+        if (end > pos) {
+            Dir d;
+            d.path = path.substr(pos, end - pos);
+            d.mtime = stamp(d.path, d.exists);
+            pathDirs.push_back(d);
+        }
+        pos = end + 1;
+    }
+}
+
+// True when one of the first upTo + 1 PATH directories changed since it
+// was stamped; everything is restamped then.
+bool CommandCache::pathChanged(size_t upTo) {
+    bool changed = false;
+    for (size_t i = 0; i <= upTo && i < pathDirs.size(); ++i) {
+        bool exists;
+        fs::file_time_type t = stamp(pathDirs[i].path, exists);
+        if (exists != pathDirs[i].exists || t != pathDirs[i].mtime) {
+            changed = true;
+            break;
+        }
+    }
+    if (changed) {
+        for (Dir& d : pathDirs) d.mtime = stamp(d.path, d.exists);
+    }
+    return changed;
+}
+
+std::string CommandCache::findInCmds(const std::string& name, const std::string& cwd) {
+    fs::path dir = fs::path(cwd) / "cmds";
+    std::string key = dir.string();
+    bool exists;
+    fs::file_time_type mtime = stamp(key, exists);
+    if (!exists) return "";
+
+    auto it = cmdsDirs.find(key);
+    if (it == cmdsDirs.end()) {
+        if (cmdsDirs.size() >= MAX_CMDS_DIRS) cmdsDirs.clear();
+        it = cmdsDirs.emplace(key, CmdsDir{ mtime, {} }).first;
+    } else if (it->second.mtime != mtime) {
+        it->second.mtime = mtime;
+        it->second.hits.clear();
+    }
+
+    auto hit = it->second.hits.find(name);
+    if (hit != it->second.hits.end()) return hit->second;
+
+    std::string found;
+    for (const char* ext : EXTENSIONS) {
+        fs::path p = dir / (name + ext);
+        std::error_code ec;
+        if (fs::exists(p, ec)) {
+            found = fs::absolute(p, ec).string();
+            break;
+        }
+    }
+    it->second.hits.emplace(name, found);
+    return found;
+}
+
+CommandCache::Hit CommandCache::findInPath(const std::string& name) {
+    for (size_t i = 0; i < pathDirs.size(); ++i) {
+        if (!pathDirs[i].exists) continue;
+#ifdef _WIN32
+        for (const char* ext : EXTENSIONS) {
+            fs::path p = fs::path(pathDirs[i].path) / (name + ext);
+            if (isProgram(p)) return { fs::absolute(p).string(), i };
+        }
+#else
+        fs::path p = fs::path(pathDirs[i].path) / name;
+        if (isProgram(p)) return { fs::absolute(p).string(), i };
+#endif
+    }
+    return { "", pathDirs.size() };
+}
+
+std::string CommandCache::resolve(const std::string& name, const std::string& cwd) {
+    if (name.empty() || name.find_first_of("/\\") != std::string::npos) return "";
+
+    std::string found = findInCmds(name, cwd);
+    if (!found.empty()) return found;
+
+    if (!pathLoaded) loadPath();
+    auto it = pathHits.find(name);
+    if (it != pathHits.end()) {
+        if (!pathChanged(it->second.dir)) return it->second.path;
+        pathHits.clear();
+    }
+    Hit hit = findInPath(name);
+    pathHits.emplace(name, hit);
+    return hit.path;
+}
+
+void CommandCache::clear() {
+    pathLoaded = false;
+    pathHits.clear();
+    cmdsDirs.clear();
+}
+
+std::vector<std::pair<std::string, std::string>> CommandCache::entries() {
+    std::vector<std::pair<std::string, std::string>> out;
+    for (const auto& c : cmdsDirs) {
+        for (const auto& h : c.second.hits) {
+            if (!h.second.empty()) out.emplace_back(h.first, h.second);
+        }
+    }
+    for (const auto& h : pathHits) {
+        if (!h.second.path.empty()) out.emplace_back(h.first, h.second.path);
+    }
+    return out;
+}
@@ -0,0 +1,52 @@
+#ifndef COMMAND_CACHE_HPP
+#define COMMAND_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+
+// Remembers where external commands were found, so launching one does not
+// probe cmds/ and every PATH directory again. Misses are remembered too.
+//
+// An entry is trusted while the directories searched to find it keep
+// their mtime: cmds/, then the PATH directories up to the one holding the
+// command (all of them for a miss). Anything installed in one of those
+// changes the mtime and empties the cache. `hash -r` empties it by hand.
+class CommandCache {
+public:
+    // Absolute path for `name`: cmds/ under cwd first, then PATH. "" when
+    // neither has it or name is a path itself.
+    static std::string resolve(const std::string& name, const std::string& cwd);
+    static void clear();
+
+    // name -> path, found commands only
+    static std::vector<std::pair<std::string, std::string>> entries();
+
+private:
+    struct Dir {
+        std::string path;
+        std::filesystem::file_time_type mtime;
+        bool exists;
+    };
+    struct Hit {
+        std::string path; // "" when not found
+        size_t dir;       // Index into pathDirs, pathDirs.size() for a miss
+    };
+    struct CmdsDir {
+        std::filesystem::file_time_type mtime;
+        std::unordered_map<std::string, std::string> hits;
+    };
+
+    static bool pathLoaded;
+    static std::vector<Dir> pathDirs;
+    static std::unordered_map<std::string, Hit> pathHits;
+    static std::unordered_map<std::string, CmdsDir> cmdsDirs; // By cmds/ path
+
+    static void loadPath();
+    static bool pathChanged(size_t upTo);
+    static std::string findInCmds(const std::string& name, const std::string& cwd);
+    static Hit findInPath(const std::string& name);
+};
+
+#endif // COMMAND_CACHE_HPP
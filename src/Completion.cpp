@@ -0,0 +1,240 @@
+#include "Completion.hpp"
+#include "Sessions.hpp"
+#include "Shell.h"
+#include <algorithm>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+std::unordered_map<std::string, Completion::Listing> Completion::dirCache;
+std::mutex Completion::pathMutex;
+std::vector<std::string> Completion::pathNames;
+std::vector<Completion::PathDir> Completion::pathDirs;
+std::thread Completion::pathThread;
+std::atomic<bool> Completion::pathBuilding(false);
+std::atomic<bool> Completion::stopping(false);
+
+namespace {
+
+// Keep in step with Shell::cmdSesh
+const char* SESH_COMMANDS[] = { "add", "detach", "list", "load", "load-workspace", "remove", "retach", "save", "save-workspace", "scrollback", "switch", "update" };
+const char* SESSION_ARG_COMMANDS[] = { "load", "remove", "update" };
+const char* WORKSPACE_ARG_COMMANDS[] = { "load-workspace", "save-workspace" };
+
+// Extensions executeExternal tries in cmds/; PATH uses them on Windows
+const char* EXEC_EXTENSIONS[] = { ".exe", ".bat", ".cmd", ".com" };
+
+// Listings kept at once; the cache starts over beyond this
+const size_t MAX_CACHED_DIRS = 64;
+
+bool startsWith(const std::string& s, const std::string& prefix) {
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Name without a known executable extension, or "" when it has another one
+// where one is required.
+std::string commandName(const std::string& file, bool needExtension) {
+    size_t dot = file.rfind('.');
+    if (dot != std::string::npos && dot > 0) {
+        std::string ext = file.substr(dot);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        for (const char* known : EXEC_EXTENSIONS) {
+            if (ext == known) return file.substr(0, dot);
+        }
+    }
+    return needExtension ? "" : file;
+}
+
+void addMatching(const char* const* list, size_t count, const std::string& prefix, std::vector<std::string>& out) {
+    for (size_t i = 0; i < count; ++i) {
+        if (startsWith(list[i], prefix)) out.push_back(list[i]);
+    }
+}
+
+}
+
+const std::vector<Completion::Entry>* Completion::listing(const fs::path& dir) {
+    std::error_code ec;
+    fs::file_time_type mtime = fs::last_write_time(dir, ec);
+    if (ec) return nullptr;
+
+    std::string key = dir.lexically_normal().string();
+    auto it = dirCache.find(key);
+    if (it != dirCache.end() && it->second.mtime == mtime) return &it->second.entries;
+
+    if (it == dirCache.end() && dirCache.size() >= MAX_CACHED_DIRS) dirCache.clear();
+    Listing& l = dirCache[key];
+    l.mtime = mtime;
+    l.entries.clear();
+    for (fs::directory_iterator d(dir, fs::directory_options::skip_permission_denied, ec), end; !ec && d != end; d.increment(ec)) {
+        std::error_code typeEc;
+        l.entries.push_back({ d->path().filename().string(), d->is_directory(typeEc) });
+    }
+    std::sort(l.entries.begin(), l.entries.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+    return &l.entries;
+}
+
+void Completion::addPaths(const std::string& word, const std::string& cwd, std::vector<std::string>& out) {
+    size_t slash = word.find_last_of("/\\");
+    std::string dirPart = slash == std::string::npos ? "" : word.substr(0, slash + 1);
+    std::string namePart = word.substr(dirPart.size());
+
+    const std::vector<Entry>* entries = listing(dirPart.empty() ? fs::path(cwd) : fs::path(cwd) / dirPart);
+    if (!entries) return;
+
+    auto it = std::lower_bound(entries->begin(), entries->end(), namePart,
+                               [](const Entry& e, const std::string& p) { return e.name < p; });
+    for (; it != entries->end() && startsWith(it->name, namePart); ++it) {
+        if (it->name[0] == '.' && namePart.empty()) continue; // Hidden unless asked for
+        out.push_back(dirPart + it->name + (it->dir ? "/" : ""));
+    }
+}
+
+void Completion::addExecutables(const std::string& prefix, const std::string& cwd, std::vector<std::string>& out) {
+    if (const std::vector<Entry>* cmds = listing(fs::path(cwd) / "cmds")) {
+        for (const Entry& e : *cmds) {
+            if (e.dir) continue;
+            std::string name = commandName(e.name, false);
+            if (startsWith(name, prefix)) out.push_back(name);
+        }
+    }
+
+    if (pathIndexStale()) startPathIndex();
+    std::lock_guard<std::mutex> lock(pathMutex);
+    auto it = std::lower_bound(pathNames.begin(), pathNames.end(), prefix);
+    for (; it != pathNames.end() && startsWith(*it, prefix); ++it) out.push_back(*it);
+}
+
+std::vector<std::string> Completion::complete(const std::string& line, const std::string& cwd, size_t& start) {
+    // Split off the word being completed; quotes keep spaces in a word
+    std::vector<std::string> words;
+    bool inQuote = false;
+    start = 0;
+    for (size_t i = 0; i < line.size(); ++i) {
+        if (line[i] == '"') {
+            inQuote = !inQuote;
+        } else if (line[i] == ' ' && !inQuote) {
+            if (i > start) words.push_back(line.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    std::string word = line.substr(start);
+    bool quoted = !word.empty() && word[0] == '"';
+    if (quoted) word.erase(0, 1);
+
+    std::vector<std::string> found;
+    if (words.empty() && word.find_first_of("/\\") == std::string::npos) {
+        addMatching(Shell::BUILTINS, Shell::BUILTIN_COUNT, word, found);
+        addExecutables(word, cwd, found);
+    } else if (words.size() == 1 && words[0] == "sesh") {
+        addMatching(SESH_COMMANDS, sizeof(SESH_COMMANDS) / sizeof(SESH_COMMANDS[0]), word, found);
+    } else if (words.size() == 2 && words[0] == "sesh" &&
+               std::find(std::begin(SESSION_ARG_COMMANDS), std::end(SESSION_ARG_COMMANDS), words[1]) != std::end(SESSION_ARG_COMMANDS)) {
+        for (const std::string& file : SessionManager::listSessions()) {
+            std::string name = fs::path(file).stem().string();
+            if (startsWith(name, word)) found.push_back(name);
+        }
+    } else if (words.size() == 2 && words[0] == "sesh" &&
+               std::find(std::begin(WORKSPACE_ARG_COMMANDS), std::end(WORKSPACE_ARG_COMMANDS), words[1]) != std::end(WORKSPACE_ARG_COMMANDS)) {
+        for (const std::string& file : SessionManager::listWorkspaces()) {
+            std::string name = fs::path(file).stem().string();
+            if (startsWith(name, word)) found.push_back(name);
+        }
+    } else {
+        addPaths(word, cwd, found);
+    }
+
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+
+    // Quote them all if one needs it, so they still share the typed prefix
+    bool quote = quoted;
+    for (const std::string& f : found) {
+        if (f.find(' ') != std::string::npos) quote = true;
+    }
+    if (quote) {
+        for (std::string& f : found) f.insert(0, 1, '"');
+    }
+    return found;
+}
+
+// ---- PATH index ----
+
+void Completion::buildPathIndex() {
+    std::vector<PathDir> dirs;
+    std::vector<std::string> names;
+
+    const char* env = getenv("PATH");
+    std::string path = env ? env : "";
+#ifdef _WIN32
+    const char separator = ';';
+#else
+    const char separator = ':';
+#endif
+
+    size_t pos = 0;
+    while (pos <= path.size() && !stopping) {
+        size_t end = path.find(separator, pos);
+        if (end == std::string::npos) end = path.size();
+        std::string dir = path.substr(pos, end - pos);
+        pos = end + 1;
+        if (dir.empty()) continue;
+
+        std::error_code ec;
+        PathDir pd = { dir, fs::last_write_time(dir, ec) };
+        if (ec) continue;
+        dirs.push_back(pd);
+
+        for (fs::directory_iterator d(dir, fs::directory_options::skip_permission_denied, ec), stop; !ec && d != stop; d.increment(ec)) {
+            if (stopping) break;
+            std::error_code typeEc;
+            if (!d->is_regular_file(typeEc)) continue;
+            std::string file = d->path().filename().string();
+#ifdef _WIN32
+            std::string name = commandName(file, true);
+#else
+            std::string name = access(d->path().c_str(), X_OK) == 0 ? file : "";
+#endif
+            if (!name.empty()) names.push_back(name);
+        }
+    }
+
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    std::lock_guard<std::mutex> lock(pathMutex);
+    pathNames.swap(names);
+    pathDirs.swap(dirs);
+}
+
+void Completion::startPathIndex() {
+    if (pathBuilding.exchange(true)) return;
+    if (pathThread.joinable()) pathThread.join();
+    pathThread = std::thread([] {
+        buildPathIndex();
+        pathBuilding = false;
+    });
+}
+
+bool Completion::pathIndexStale() {
+    if (pathBuilding) return false;
+    std::vector<PathDir> dirs;
+    {
+        std::lock_guard<std::mutex> lock(pathMutex);
+        dirs = pathDirs;
+    }
+    for (const PathDir& d : dirs) {
+        std::error_code ec;
+        if (fs::last_write_time(d.path, ec) != d.mtime || ec) return true;
+    }
+    return false;
+}
+
+void Completion::shutdown() {
+    stopping = true;
+    if (pathThread.joinable()) pathThread.join();
+}
@@ -0,0 +1,59 @@
+#ifndef COMPLETION_HPP
+#define COMPLETION_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+// Tab completion for the prompt: builtins, sesh subcommands and session
+// names, executables from cmds/ and PATH, and paths relative to the
+// session's directory.
+//
+// Directory listings are cached and only reread when the directory's mtime
+// changes, so completing in a huge directory costs a stat and a binary
+// search. The PATH executable index is built on a background thread, and
+// rebuilt there when one of the PATH directories changes.
+class Completion {
+public:
+    // Candidates for the last word of `line` (the input up to the cursor).
+    // Each one replaces line.substr(start); directories end in '/'.
+    static std::vector<std::string> complete(const std::string& line, const std::string& cwd, size_t& start);
+
+    static void startPathIndex();
+    static void shutdown();
+
+private:
+    struct Entry {
+        std::string name;
+        bool dir;
+    };
+    struct Listing {
+        std::filesystem::file_time_type mtime;
+        std::vector<Entry> entries; // Sorted by name
+    };
+    struct PathDir {
+        std::string path;
+        std::filesystem::file_time_type mtime;
+    };
+
+    static std::unordered_map<std::string, Listing> dirCache;
+
+    static std::mutex pathMutex;
+    static std::vector<std::string> pathNames; // Sorted, unique
+    static std::vector<PathDir> pathDirs;      // What pathNames was built from
+    static std::thread pathThread;
+    static std::atomic<bool> pathBuilding;
+    static std::atomic<bool> stopping;
+
+    static const std::vector<Entry>* listing(const std::filesystem::path& dir);
+    static void addPaths(const std::string& word, const std::string& cwd, std::vector<std::string>& out);
+    static void addExecutables(const std::string& prefix, const std::string& cwd, std::vector<std::string>& out);
+    static void buildPathIndex();
+    static bool pathIndexStale();
+};
+
+#endif // COMPLETION_HPP
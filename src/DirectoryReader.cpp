@@ -0,0 +1,213 @@
+#include "DirectoryReader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace {
+
+const unsigned MAX_STAT_THREADS = 8;
+
+// Below this many entries one thread stats them all
+const size_t PARALLEL_STAT_MIN = 2048;
+
+#ifdef __linux__
+// Bytes asked of the kernel per getdents64 call
+const size_t DIRENT_BUFFER = 256 * 1024;
+
+// Layout of struct linux_dirent64 (glibc does not always declare it)
+const size_t DIRENT_RECLEN = 16;
+const size_t DIRENT_TYPE = 18;
+const size_t DIRENT_NAME = 19;
+#endif
+
+#ifndef _WIN32
+DirectoryReader::Type fromMode(mode_t m) {
+    if (S_ISREG(m)) return DirectoryReader::REGULAR;
+    if (S_ISDIR(m)) return DirectoryReader::DIR;
+    if (S_ISLNK(m)) return DirectoryReader::LINK;
+    return DirectoryReader::OTHER;
+}
+
+DirectoryReader::Type fromDirentType(unsigned char t) {
+    switch (t) {
+        case DT_REG: return DirectoryReader::REGULAR;
+        case DT_DIR: return DirectoryReader::DIR;
+        case DT_LNK: return DirectoryReader::LINK;
+        case DT_UNKNOWN: return DirectoryReader::UNKNOWN;
+        default: return DirectoryReader::OTHER;
+    }
+}
+#else
+// FILETIME counts 100ns steps from 1601
+int64_t unixTime(const FILETIME& ft) {
+    uint64_t t = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return (int64_t)(t / 10000000ULL) - 11644473600LL;
+}
+
+bool executableName(const char* name) {
+    const char* dot = strrchr(name, '.');
+    if (!dot) return false;
+    for (const char* ext : { ".exe", ".bat", ".cmd", ".com" }) {
+        if (_stricmp(dot, ext) == 0) return true;
+    }
+    return false;
+}
+#endif
+
+}
+
+void DirectoryReader::add(const char* name, size_t length, Type type) {
+    Entry e;
+    e.nameOffset = (uint32_t)names.size();
+    e.nameLength = (uint32_t)length;
+    e.type = type;
+    names.append(name, length);
+    names.push_back('\0'); // For fstatat
+    list.push_back(e);
+}
+
+bool DirectoryReader::read(const std::string& dir, bool hidden, std::string& error) {
+    path = dir;
+    names.clear();
+    list.clear();
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE h = FindFirstFileExA((dir + "\\*").c_str(), FindExInfoBasic, &data,
+                                FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (h == INVALID_HANDLE_VALUE) {
+        error = GetLastError() == ERROR_ACCESS_DENIED ? "permission denied" : "directory not found";
+        return false;
+    }
+    do {
+        const char* name = data.cFileName;
+        if (name[0] == '.' && (!hidden || name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+        DWORD attrs = data.dwFileAttributes;
+        Type type = (attrs & FILE_ATTRIBUTE_REPARSE_POINT) ? LINK
+                  : (attrs & FILE_ATTRIBUTE_DIRECTORY) ? DIR : REGULAR;
+        add(name, strlen(name), type);
+        Entry& e = list.back();
+        e.statted = true;
+        e.size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+        e.mtime = unixTime(data.ftLastWriteTime);
+        e.executable = type == REGULAR && executableName(name);
+        e.mode = (attrs & FILE_ATTRIBUTE_READONLY) ? 0555 : 0755;
+        if (type == REGULAR && !e.executable) e.mode &= 0666;
+    } while (FindNextFileA(h, &data));
+    FindClose(h);
+    return true;
+#else
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        error = errno == EACCES ? "permission denied"
+              : errno == ENOTDIR ? "not a directory" : "directory not found";
+        return false;
+    }
+
+    auto take = [&](const char* name, unsigned char type) {
+        if (name[0] == '.' && (!hidden || name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) return;
+        add(name, strlen(name), fromDirentType(type));
+    };
+
+#ifdef __linux__
+    std::vector<char> buffer(DIRENT_BUFFER);
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            error = strerror(errno);
+            close(fd);
+            return false;
+        }
+        if (n == 0) break;
+        for (long off = 0; off < n;) {
+            const char* d = buffer.data() + off;
+            unsigned short reclen;
+            memcpy(&reclen, d + DIRENT_RECLEN, sizeof(reclen));
+            take(d + DIRENT_NAME, (unsigned char)d[DIRENT_TYPE]);
+            off += reclen;
+        }
+    }
+    close(fd);
+#else
+    ::DIR* d = fdopendir(fd);
+    if (!d) {
+        close(fd);
+        error = "permission denied";
+        return false;
+    }
+    errno = 0;
+    while (struct dirent* ent = readdir(d)) take(ent->d_name, ent->d_type);
+    if (errno != 0) {
+        error = strerror(errno);
+        closedir(d);
+        return false;
+    }
+    closedir(d);
+#endif
+    return true;
+#endif
+}
+
+void DirectoryReader::statAll(bool unknownOnly) {
+#ifdef _WIN32
+    (void)unknownOnly; // The listing had everything
+#else
+    std::vector<size_t> todo;
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (!list[i].statted && (!unknownOnly || list[i].type == UNKNOWN)) todo.push_back(i);
+    }
+    if (todo.empty()) return;
+
+    int dirFd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0) return;
+
+    auto statRange = [&](size_t from, size_t to) {
+        struct stat st;
+        for (size_t k = from; k < to; ++k) {
+            Entry& e = list[todo[k]];
+            if (fstatat(dirFd, names.data() + e.nameOffset, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            e.statted = true;
+            e.type = fromMode(st.st_mode);
+            e.mode = st.st_mode & 07777;
+            e.size = (uint64_t)st.st_size;
+            e.mtime = (int64_t)st.st_mtime;
+            e.executable = e.type == REGULAR && (st.st_mode & 0111);
+        }
+    };
+
+    // Each thread takes a contiguous slice; stats of one directory cost
+    // about the same, so slices finish together.
+    unsigned threads = std::max(1u, std::min(MAX_STAT_THREADS, std::thread::hardware_concurrency()));
+    if (todo.size() < PARALLEL_STAT_MIN) threads = 1;
+    std::vector<std::thread> pool;
+    size_t per = (todo.size() + threads - 1) / threads;
+    for (unsigned t = 1; t < threads; ++t) {
+        size_t from = std::min(todo.size(), t * per);
+        size_t to = std::min(todo.size(), from + per);
+        pool.emplace_back(statRange, from, to);
+    }
+    statRange(0, std::min(todo.size(), per));
+    for (auto& t : pool) t.join();
+    close(dirFd);
+#endif
+}
+
+void DirectoryReader::sort() {
+    std::sort(list.begin(), list.end(), [this](const Entry& a, const Entry& b) {
+        return name(a) < name(b);
+    });
+}
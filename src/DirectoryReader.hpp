@@ -0,0 +1,56 @@
+#ifndef DIRECTORY_READER_HPP
+#define DIRECTORY_READER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// One directory read in bulk: getdents64 with a large buffer on Linux,
+// readdir on other POSIX systems, FindFirstFileEx with large fetches on
+// Windows. Names share one buffer, so a huge directory costs a handful of
+// allocations rather than one or more per entry.
+//
+// Types come for free from the listing where the file system reports
+// them; sizes, times and modes need statAll() (except on Windows, where the
+// listing carries them).
+class DirectoryReader {
+public:
+    enum Type : unsigned char { UNKNOWN, REGULAR, DIR, LINK, OTHER };
+
+    struct Entry {
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        Type type = UNKNOWN;
+        bool statted = false;
+        bool executable = false;
+        uint32_t mode = 0;      // POSIX permission bits
+        uint64_t size = 0;
+        int64_t mtime = 0;      // Seconds since the Unix epoch
+    };
+
+    // Leaves out "." and "..", and other names starting with '.' unless
+    // hidden. False with error set when the directory cannot be read.
+    bool read(const std::string& dir, bool hidden, std::string& error);
+
+    // Fills in what read() could not, spread over a few threads. With
+    // unknownOnly, only entries whose type the listing did not give.
+    void statAll(bool unknownOnly);
+
+    // By name, byte by byte (no locale)
+    void sort();
+
+    const std::vector<Entry>& entries() const { return list; }
+    std::string_view name(const Entry& e) const {
+        return std::string_view(names.data() + e.nameOffset, e.nameLength);
+    }
+
+private:
+    std::string path;
+    std::string names;
+    std::vector<Entry> list;
+
+    void add(const char* name, size_t length, Type type);
+};
+
+#endif // DIRECTORY_READER_HPP
@@ -0,0 +1,113 @@
+#include "EventLoop.hpp"
+#include <algorithm>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#endif
+
+namespace {
+#ifdef _WIN32
+HANDLE wakeEvent = NULL;
+#else
+int wakeRead = -1;
+int wakeWrite = -1;
+#endif
+}
+
+EventLoop::EventLoop() {
+#ifdef _WIN32
+    if (!wakeEvent) wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+    if (wakeRead < 0) {
+        int fds[2];
+        if (pipe(fds) == 0) {
+            for (int fd : fds) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+            wakeRead = fds[0];
+            wakeWrite = fds[1];
+        }
+    }
+#endif
+}
+
+EventLoop::~EventLoop() {}
+
+void EventLoop::clear() {
+    sources.clear();
+}
+
+void EventLoop::watch(Source source) {
+#ifdef _WIN32
+    if (source == NULL) return;
+#else
+    if (source < 0) return;
+#endif
+    sources.push_back(source);
+}
+
+bool EventLoop::isReady(Source source) const {
+    return std::find(readySources.begin(), readySources.end(), source) != readySources.end();
+}
+
+void EventLoop::notify() {
+#ifdef _WIN32
+    if (wakeEvent) SetEvent(wakeEvent);
+#else
+    if (wakeWrite >= 0) {
+        char b = 1;
+        ssize_t r = write(wakeWrite, &b, 1); // Full pipe means a wake is already pending
+        (void)r;
+    }
+#endif
+}
+
+#ifdef _WIN32
+bool EventLoop::wait(int timeoutMs) {
+    readySources.clear();
+
+    std::vector<HANDLE> handles;
+    handles.push_back(wakeEvent);
+    for (HANDLE h : sources) {
+        if (handles.size() >= MAXIMUM_WAIT_OBJECTS) break;
+        if (h) handles.push_back(h);
+    }
+
+    DWORD timeout = timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs;
+    DWORD res = WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE, timeout);
+    if (res == WAIT_TIMEOUT || res == WAIT_FAILED) return false;
+
+    // WaitForMultipleObjects only reports the first signalled handle; pick
+    // up the rest so the caller can drain them in one batch.
+    for (size_t i = 1; i < handles.size(); ++i) {
+        if (WaitForSingleObject(handles[i], 0) == WAIT_OBJECT_0) readySources.push_back(handles[i]);
+    }
+    return true;
+}
+#else
+bool EventLoop::wait(int timeoutMs) {
+    readySources.clear();
+
+    std::vector<pollfd> fds;
+    fds.push_back({wakeRead, POLLIN, 0});
+    for (int fd : sources) {
+        if (fd >= 0) fds.push_back({fd, POLLIN, 0});
+    }
+
+    int n = poll(fds.data(), fds.size(), timeoutMs);
+    if (n <= 0) return false; // Timeout, or EINTR from a signal
+
+    if (fds[0].revents) {
+        char buf[64];
+        while (read(wakeRead, buf, sizeof(buf)) > 0) {}
+    }
+    for (size_t i = 1; i < fds.size(); ++i) {
+        if (fds[i].revents) readySources.push_back(fds[i].fd);
+    }
+    return true;
+}
+#endif
@@ -0,0 +1,42 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Readiness multiplexer for the main loop. The loop registers what it wants
+// to hear about (console input, running children), then sleeps in wait()
+// until one of them is ready, notify() is called, or the timeout expires.
+// Windows waits on handles with WaitForMultipleObjects; elsewhere this is
+// poll() on file descriptors plus a self-pipe for notify().
+class EventLoop {
+public:
+#ifdef _WIN32
+    typedef HANDLE Source;
+#else
+    typedef int Source;
+#endif
+
+    EventLoop();
+    ~EventLoop();
+
+    void clear();
+    void watch(Source source); // Ignores null handles / negative fds
+    // Blocks until a source is ready, notify() is called or timeoutMs
+    // passes (-1 waits forever). Returns false on timeout.
+    bool wait(int timeoutMs);
+    bool isReady(Source source) const;
+
+    // Wakes a pending wait(). Safe from other threads and, on POSIX, from
+    // signal handlers.
+    static void notify();
+
+private:
+    std::vector<Source> sources;
+    std::vector<Source> readySources;
+};
+
+#endif // EVENT_LOOP_HPP
@@ -0,0 +1,529 @@
+#include "FileOps.hpp"
+#include "DirectoryReader.hpp"
+#include "WorkStealing.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#endif
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Copies wait on the disk far more than on the CPU, so even one core
+// keeps a couple of them in flight
+const unsigned MIN_COPY_THREADS = 2;
+const unsigned MAX_COPY_THREADS = 8;
+
+// Removal is all metadata updates; a few more threads keep the file
+// system's journal busy
+const unsigned MIN_REMOVE_THREADS = 2;
+const unsigned MAX_REMOVE_THREADS = 16;
+
+// Bytes per kernel copy call; cancellation is checked in between
+const size_t COPY_CHUNK = 16 * 1024 * 1024;
+
+// Used where the kernel cannot copy for us
+const size_t BUFFER_BYTES = 1024 * 1024;
+
+const auto PROGRESS_INTERVAL = std::chrono::milliseconds(100);
+
+// Errors listed after the summary; the rest are only counted
+const size_t MAX_LISTED_ERRORS = 20;
+
+struct CopyTask {
+    std::string from;
+    std::string to;
+};
+
+struct Plan {
+    std::vector<CopyTask> files;
+    uint64_t bytes = 0;
+    std::vector<std::string> errors;
+};
+
+// A directory being removed. It goes once its listing has been emptied
+// and each of its subdirectories has gone, whichever thread finishes last.
+struct RemoveNode {
+    std::string path;
+    std::shared_ptr<RemoveNode> parent;
+    std::atomic<size_t> pending{1}; // The listing, plus subdirectories still there
+    std::atomic<bool> failed{false}; // Something under it stays, so it must too
+};
+
+struct Removal {
+    Job& job;
+    std::atomic<uint64_t> removed{0};
+    std::mutex lock;
+    std::vector<std::string> errors;
+
+    explicit Removal(Job& job) : job(job) {}
+
+    void fail(const std::string& path, const std::string& error) {
+        std::lock_guard<std::mutex> guard(lock);
+        errors.push_back(path + ": " + error);
+    }
+
+    bool unlinkEntry(int dirFd, const std::string& dir, std::string_view name, bool isDir) {
+        std::string full = dir + (char)fs::path::preferred_separator + std::string(name);
+#ifdef _WIN32
+        (void)dirFd;
+        (void)isDir;
+        std::error_code ec;
+        fs::remove(full, ec); // Also clears the read-only attribute
+        if (ec) {
+            fail(full, ec.message());
+            return false;
+        }
+#else
+        if (unlinkat(dirFd, std::string(name).c_str(), isDir ? AT_REMOVEDIR : 0) != 0) {
+            fail(full, std::error_code(errno, std::generic_category()).message());
+            return false;
+        }
+#endif
+        removed++;
+        return true;
+    }
+
+    // Lists node's directory, unlinks everything that is not a directory
+    // and queues the directories.
+    void visit(WorkStealingPool<std::shared_ptr<RemoveNode>>& pool, unsigned self,
+               const std::shared_ptr<RemoveNode>& node) {
+        DirectoryReader dir;
+        std::string error;
+        if (!dir.read(node->path, true, error)) {
+            fail(node->path, error);
+            node->failed = true;
+            finish(node);
+            return;
+        }
+        dir.statAll(true); // Only where the listing gave no type
+        int dirFd = -1;
+#ifndef _WIN32
+        dirFd = open(node->path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (dirFd < 0) {
+            fail(node->path, std::error_code(errno, std::generic_category()).message());
+            node->failed = true;
+            finish(node);
+            return;
+        }
+#endif
+        for (const auto& e : dir.entries()) {
+            if (job.cancelled()) break;
+            std::string_view name = dir.name(e);
+            if (e.type == DirectoryReader::DIR) {
+                auto child = std::make_shared<RemoveNode>();
+                child->path = node->path + (char)fs::path::preferred_separator + std::string(name);
+                child->parent = node;
+                node->pending++;
+                pool.push(self, std::move(child));
+            } else if (!unlinkEntry(dirFd, node->path, name, false)) {
+                node->failed = true;
+            }
+        }
+#ifndef _WIN32
+        close(dirFd);
+#endif
+        finish(node);
+    }
+
+    // One less thing in the way of node; when nothing is left, removes it
+    // and tells its parent, and so on up.
+    void finish(std::shared_ptr<RemoveNode> node) {
+        while (node && --node->pending == 0) {
+            std::shared_ptr<RemoveNode> parent = node->parent;
+            if (node->failed) {
+                if (parent) parent->failed = true;
+            } else {
+                std::error_code ec;
+                if (fs::remove(node->path, ec)) removed++;
+                else {
+                    fail(node->path, ec ? ec.message() : "not removed");
+                    if (parent) parent->failed = true;
+                }
+            }
+            node = parent;
+        }
+    }
+};
+
+std::string megabytes(uint64_t bytes) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.1f MB", bytes / (1024.0 * 1024.0));
+    return buf;
+}
+
+// Redraws the line the cursor is on
+void progress(Job& job, const std::string& text) {
+    job.write("\r\033[K" + text);
+}
+
+void listErrors(Job& job, const std::vector<std::string>& errors) {
+    for (size_t i = 0; i < errors.size() && i < MAX_LISTED_ERRORS; ++i) {
+        job.write("\033[31mMinsh: " + errors[i] + "\033[0m\n");
+    }
+    if (errors.size() > MAX_LISTED_ERRORS) {
+        job.write("\033[31m... and " + std::to_string(errors.size() - MAX_LISTED_ERRORS) + " more errors\033[0m\n");
+    }
+}
+
+#ifdef _WIN32
+struct CopyProgress {
+    std::atomic<uint64_t>* copied;
+    uint64_t reported;
+    const Job* job;
+};
+
+DWORD CALLBACK onCopyProgress(LARGE_INTEGER, LARGE_INTEGER transferred, LARGE_INTEGER, LARGE_INTEGER,
+                              DWORD, DWORD, HANDLE, HANDLE, LPVOID data) {
+    CopyProgress* p = static_cast<CopyProgress*>(data);
+    *p->copied += (uint64_t)transferred.QuadPart - p->reported;
+    p->reported = (uint64_t)transferred.QuadPart;
+    return p->job->cancelled() ? PROGRESS_CANCEL : PROGRESS_CONTINUE;
+}
+#else
+bool writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+#endif
+
+// Walks from, making its directories under to and recreating its links,
+// and lists the files for the pool.
+void planTree(Job& job, const fs::path& from, const fs::path& to, Plan& plan) {
+    std::vector<std::pair<fs::path, fs::path>> pending = { { from, to } };
+    auto last = std::chrono::steady_clock::now();
+    while (!pending.empty() && !job.cancelled()) {
+        fs::path src = pending.back().first;
+        fs::path dst = pending.back().second;
+        pending.pop_back();
+
+        std::error_code ec;
+        fs::create_directory(dst, src, ec); // Takes src's permissions
+        if (ec && !fs::is_directory(dst)) {
+            plan.errors.push_back(dst.string() + ": " + ec.message());
+            continue;
+        }
+
+        DirectoryReader dir;
+        std::string error;
+        if (!dir.read(src.string(), true, error)) {
+            plan.errors.push_back(src.string() + ": " + error);
+            continue;
+        }
+        dir.statAll(false); // Sizes for the progress line
+        for (const auto& e : dir.entries()) {
+            std::string name(dir.name(e));
+            fs::path s = src / name;
+            fs::path d = dst / name;
+            switch (e.type) {
+                case DirectoryReader::DIR:
+                    pending.emplace_back(s, d);
+                    break;
+                case DirectoryReader::REGULAR:
+                    plan.files.push_back({ s.string(), d.string() });
+                    plan.bytes += e.size;
+                    break;
+                case DirectoryReader::LINK:
+                    fs::remove(d, ec);
+                    fs::copy_symlink(s, d, ec);
+                    if (ec) plan.errors.push_back(d.string() + ": " + ec.message());
+                    break;
+                default:
+                    plan.errors.push_back(s.string() + ": not a regular file, skipped");
+                    break;
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last >= PROGRESS_INTERVAL) {
+            progress(job, "scanning: " + std::to_string(plan.files.size()) + " files");
+            last = now;
+        }
+    }
+}
+
+}
+
+bool FileOps::copyFile(const std::string& from, const std::string& to, std::string& error,
+                       std::atomic<uint64_t>& copied, const Job& job) {
+#ifdef _WIN32
+    CopyProgress p = { &copied, 0, &job };
+    BOOL cancel = FALSE;
+    if (!CopyFileExA(from.c_str(), to.c_str(), onCopyProgress, &p, &cancel, 0)) {
+        error = job.cancelled() ? "cancelled" : "copy failed (" + std::to_string(GetLastError()) + ")";
+        return false;
+    }
+    return true;
+#else
+    // Opening a FIFO or a device could block or never end
+    struct stat st;
+    if (stat(from.c_str(), &st) != 0) {
+        error = strerror(errno);
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        error = "not a regular file";
+        return false;
+    }
+    int in = open(from.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (in < 0) {
+        error = strerror(errno);
+        return false;
+    }
+    if (fstat(in, &st) != 0) {
+        error = strerror(errno);
+        close(in);
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) { // Replaced since the stat
+        error = "not a regular file";
+        close(in);
+        return false;
+    }
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777);
+    if (out < 0) {
+        error = strerror(errno);
+        close(in);
+        return false;
+    }
+    fchmod(out, st.st_mode & 07777); // When it already existed
+
+    bool ok = true;
+    bool cloned = false;
+#ifdef __linux__
+    // A reflink shares the source's blocks: no data moves at all
+    if (st.st_size > 0 && ioctl(out, FICLONE, in) == 0) {
+        copied += (uint64_t)st.st_size;
+        cloned = true;
+    }
+    enum { COPY_RANGE, SEND_FILE, READ_WRITE } method = COPY_RANGE;
+#else
+    enum { READ_WRITE } method = READ_WRITE;
+#endif
+    std::vector<char> buffer;
+    uint64_t total = 0;
+    while (!cloned) {
+        if (job.cancelled()) {
+            error = "cancelled";
+            ok = false;
+            break;
+        }
+        ssize_t n;
+#ifdef __linux__
+        if (method == COPY_RANGE) {
+            n = copy_file_range(in, NULL, out, NULL, COPY_CHUNK, 0);
+            // Older kernels and some file system pairs cannot; fall back
+            // before anything was written
+            if (n < 0 && total == 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+                method = SEND_FILE;
+                continue;
+            }
+        } else if (method == SEND_FILE) {
+            n = sendfile(out, in, NULL, COPY_CHUNK);
+            if (n < 0 && total == 0 && (errno == ENOSYS || errno == EINVAL)) {
+                method = READ_WRITE;
+                continue;
+            }
+        } else
+#endif
+        {
+            if (buffer.empty()) buffer.resize(BUFFER_BYTES);
+            n = read(in, buffer.data(), buffer.size());
+            if (n > 0 && !writeAll(out, buffer.data(), (size_t)n)) n = -1;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            error = strerror(errno);
+            ok = false;
+            break;
+        }
+        if (n == 0) break;
+        total += (uint64_t)n;
+        copied += (uint64_t)n;
+    }
+
+    close(in);
+    if (close(out) != 0 && ok) {
+        error = strerror(errno);
+        ok = false;
+    }
+    if (!ok) unlink(to.c_str());
+    return ok;
+#endif
+}
+
+bool FileOps::copyAll(Job& job, const std::string& from, const std::string& to, bool tree, bool moving) {
+    std::string doing = moving ? "moving" : "copying";
+    std::string did = moving ? "moved" : "copied";
+    Plan plan;
+    if (tree) {
+        planTree(job, from, to, plan);
+    } else {
+        std::error_code ec;
+        uint64_t size = fs::file_size(from, ec);
+        plan.files.push_back({ from, to });
+        plan.bytes = ec ? 0 : size;
+    }
+
+    // The pool: each thread takes the next file until none are left
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> done(0);
+    std::atomic<uint64_t> copied(0);
+    std::mutex lock;
+    std::condition_variable finished;
+    size_t files = plan.files.size();
+    unsigned threads = std::min(MAX_COPY_THREADS, std::max(MIN_COPY_THREADS, std::thread::hardware_concurrency()));
+    threads = (unsigned)std::min<size_t>(threads, files);
+    unsigned running = threads;
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back([&] {
+            std::string error;
+            while (!job.cancelled()) {
+                size_t i = next++;
+                if (i >= files) break;
+                if (!copyFile(plan.files[i].from, plan.files[i].to, error, copied, job) && !job.cancelled()) {
+                    std::lock_guard<std::mutex> guard(lock);
+                    plan.errors.push_back(plan.files[i].to + ": " + error);
+                }
+                done++;
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            running--;
+            finished.notify_all();
+        });
+    }
+
+    std::string total = std::to_string(files);
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!finished.wait_for(guard, PROGRESS_INTERVAL, [&] { return running == 0; })) {
+            guard.unlock();
+            progress(job, doing + ": " + std::to_string(done) + "/" + total + " files, " +
+                          megabytes(copied) + " of " + megabytes(plan.bytes));
+            guard.lock();
+        }
+    }
+    for (auto& t : pool) t.join();
+
+    if (job.cancelled()) {
+        progress(job, doing + " cancelled after " + std::to_string(done) + " of " + total + " files\n");
+        return false;
+    }
+    progress(job, did + " " + total + (files == 1 ? " file, " : " files, ") + megabytes(copied) + "\n");
+    listErrors(job, plan.errors);
+    return plan.errors.empty();
+}
+
+void FileOps::copy(Job& job, const std::string& from, const std::string& to, bool tree) {
+    copyAll(job, from, to, tree, false);
+}
+
+void FileOps::moveByCopy(Job& job, const std::string& from, const std::string& to) {
+    std::error_code ec;
+    fs::file_status status = fs::symlink_status(from, ec);
+    if (fs::is_symlink(status)) {
+        // The link itself moves, as planTree recreates links in a tree
+        fs::remove(to, ec);
+        fs::copy_symlink(from, to, ec);
+        if (ec || !fs::remove(from, ec)) {
+            job.write("\033[31mMinsh: move: " + from + ": " + ec.message() + "\033[0m\n");
+            return;
+        }
+        job.write("moved 1 link\n");
+        return;
+    }
+    bool tree = fs::is_directory(status);
+    if (!copyAll(job, from, to, tree, true)) {
+        if (!job.cancelled()) job.write("\033[31mMinsh: move: " + from + " was left in place\033[0m\n");
+        return;
+    }
+    if (tree) {
+        removeAll(job, from, true);
+    } else if (!fs::remove(from, ec)) {
+        job.write("\033[31mMinsh: move: " + from + ": " + ec.message() + "\033[0m\n");
+    }
+}
+
+bool FileOps::removeAll(Job& job, const std::string& path, bool moving) {
+    Removal removal(job);
+    std::error_code ec;
+    if (!fs::is_directory(fs::symlink_status(path, ec))) {
+        if (fs::remove(path, ec)) removal.removed++;
+        else removal.fail(path, ec ? ec.message() : "not found");
+    } else {
+        unsigned threads = std::min(MAX_REMOVE_THREADS, std::max(MIN_REMOVE_THREADS, std::thread::hardware_concurrency()));
+        WorkStealingPool<std::shared_ptr<RemoveNode>> pool(threads);
+        auto root = std::make_shared<RemoveNode>();
+        root->path = path;
+        pool.push(0, std::move(root));
+
+        // The pool runs on its own thread so this one can draw progress
+        std::mutex lock;
+        std::condition_variable finished;
+        bool running = true;
+        std::thread walker([&] {
+            pool.run(
+                [&](unsigned self, const std::shared_ptr<RemoveNode>& node) { removal.visit(pool, self, node); },
+                [](unsigned) {},
+                [&] { return job.cancelled(); });
+            std::lock_guard<std::mutex> guard(lock);
+            running = false;
+            finished.notify_all();
+        });
+        std::string doing = moving ? "removing source: " : "removing: ";
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while (!finished.wait_for(guard, PROGRESS_INTERVAL, [&] { return !running; })) {
+                guard.unlock();
+                progress(job, doing + std::to_string(removal.removed) + " entries");
+                guard.lock();
+            }
+        }
+        walker.join();
+    }
+
+    std::string count = std::to_string(removal.removed);
+    if (job.cancelled()) {
+        progress(job, "removing cancelled after " + count + " entries\n");
+        return false;
+    }
+    if (moving) progress(job, "");
+    else progress(job, "removed " + count + (removal.removed == 1 ? " entry\n" : " entries\n"));
+    if (moving && !removal.errors.empty()) job.write("\033[31mMinsh: move: " + path + " was only partly removed\033[0m\n");
+    listErrors(job, removal.errors);
+    return removal.errors.empty();
+}
+
+void FileOps::remove(Job& job, const std::string& path) {
+    removeAll(job, path, false);
+}
@@ -0,0 +1,39 @@
+#ifndef FILE_OPS_HPP
+#define FILE_OPS_HPP
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include "Job.hpp"
+
+// The bodies of the copy, move and remove -d builtins, run as Jobs. Files
+// are copied inside the kernel wherever the platform allows: a reflink
+// (FICLONE) when the file system can share blocks, else copy_file_range,
+// else sendfile on Linux; CopyFileEx on Windows. Directory trees are
+// scanned first, then their files are copied by a small pool of threads
+// while a progress line is redrawn in place. Trees are removed by a
+// work-stealing pool, one directory per task.
+class FileOps {
+public:
+    // Copies one file over `to`, keeping its permissions. Adds to copied as
+    // bytes land and gives up (removing the partial copy) once job is
+    // cancelled.
+    static bool copyFile(const std::string& from, const std::string& to, std::string& error,
+                         std::atomic<uint64_t>& copied, const Job& job);
+
+    // copy [-d]: from is a file or (with tree) a directory; to is the path
+    // it gets, not a directory to put it in.
+    static void copy(Job& job, const std::string& from, const std::string& to, bool tree);
+    // move across file systems: copies, then removes the source if every
+    // file made it.
+    static void moveByCopy(Job& job, const std::string& from, const std::string& to);
+    // remove -d: deletes a directory and everything under it. A link to a
+    // directory is removed itself, never followed.
+    static void remove(Job& job, const std::string& path);
+
+private:
+    static bool copyAll(Job& job, const std::string& from, const std::string& to, bool tree, bool moving);
+    static bool removeAll(Job& job, const std::string& path, bool moving);
+};
+
+#endif // FILE_OPS_HPP
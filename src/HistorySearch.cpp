@@ -0,0 +1,77 @@
+#include "HistorySearch.hpp"
+#include "HistoryStore.hpp"
+#include <algorithm>
+
+bool HistorySearch::built = false;
+size_t HistorySearch::indexed = 0;
+std::unordered_map<uint32_t, std::vector<uint32_t>> HistorySearch::postings;
+std::vector<uint64_t> HistorySearch::masks;
+
+namespace {
+
+uint32_t trigram(const std::string& s, size_t i) {
+    return ((uint32_t)(unsigned char)s[i] << 16) | ((uint32_t)(unsigned char)s[i + 1] << 8) | (unsigned char)s[i + 2];
+}
+
+uint64_t byteMask(const std::string& s) {
+    uint64_t m = 0;
+    for (unsigned char c : s) m |= 1ULL << (c & 63);
+    return m;
+}
+
+}
+
+void HistorySearch::indexEntry(size_t i) {
+    const std::string& cmd = HistoryStore::at(i);
+    masks.push_back(byteMask(cmd));
+    for (size_t k = 0; k + 3 <= cmd.size(); ++k) {
+        std::vector<uint32_t>& list = postings[trigram(cmd, k)];
+        if (list.empty() || list.back() != i) list.push_back((uint32_t)i);
+    }
+}
+
+void HistorySearch::update() {
+    if (!built) return;
+    // The store only shrinks when it is reloaded; start over then.
+    if (HistoryStore::size() < indexed) {
+        postings.clear();
+        masks.clear();
+        indexed = 0;
+    }
+    while (indexed < HistoryStore::size()) indexEntry(indexed++);
+}
+
+int HistorySearch::find(const std::string& query, int before) {
+    if (!built) {
+        built = true;
+        update();
+    }
+    before = std::min(before, (int)indexed);
+    if (query.empty()) return -1;
+
+    // Entries left empty by a command being run again never match: the
+    // query is not empty.
+    if (query.size() < 3) {
+        uint64_t need = byteMask(query);
+        for (int i = before - 1; i >= 0; --i) {
+            if ((masks[i] & need) == need && HistoryStore::at(i).find(query) != std::string::npos) return i;
+        }
+        return -1;
+    }
+
+    // Walk the shortest posting list of the query's trigrams, newest
+    // first, and confirm each candidate.
+    const std::vector<uint32_t>* shortest = nullptr;
+    for (size_t k = 0; k + 3 <= query.size(); ++k) {
+        auto it = postings.find(trigram(query, k));
+        if (it == postings.end()) return -1;
+        if (!shortest || it->second.size() < shortest->size()) shortest = &it->second;
+    }
+
+    auto end = std::lower_bound(shortest->begin(), shortest->end(), (uint32_t)before);
+    for (auto it = end; it != shortest->begin();) {
+        --it;
+        if (HistoryStore::at(*it).find(query) != std::string::npos) return (int)*it;
+    }
+    return -1;
+}
@@ -0,0 +1,29 @@
+#ifndef HISTORY_SEARCH_HPP
+#define HISTORY_SEARCH_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Substring search over HistoryStore for Ctrl+R. Built on first use: a
+// posting list of entry indices per trigram, plus a 64-bit mask per entry
+// of which bytes it contains (for queries shorter than a trigram). New
+// commands are indexed as they are added.
+class HistorySearch {
+public:
+    // Most recent entry below `before` containing query, or -1.
+    static int find(const std::string& query, int before);
+    // Indexes entries added since the last call; no-op until first use.
+    static void update();
+
+private:
+    static bool built;
+    static size_t indexed;
+    static std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+    static std::vector<uint64_t> masks;
+
+    static void indexEntry(size_t i);
+};
+
+#endif // HISTORY_SEARCH_HPP
@@ -0,0 +1,285 @@
+#include "HistoryStore.hpp"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+std::string HistoryStore::filePath;
+std::deque<std::string> HistoryStore::entries;
+std::unordered_map<std::string_view, size_t> HistoryStore::index;
+std::vector<uint32_t> HistoryStore::useCounts;
+uint64_t HistoryStore::rev = 0;
+
+namespace {
+
+// Loading rewrites the file once it holds this many lines and at least
+// twice as many as there are distinct commands.
+const size_t COMPACT_MIN_LINES = 1000;
+
+// Exclusive lock on the whole history file for as long as it lives, so
+// appends and compaction from several processes do not interleave.
+// Read-only mappings are used while it is held.
+//
+// Compaction writes a new file and renames it over the old one, so a
+// crash or a full disk midway leaves the old history whole. Whoever was
+// waiting for the lock then holds it on the replaced file; it notices and
+// opens the path again.
+struct LockedFile {
+    std::string path;
+#ifdef _WIN32
+    HANDLE h = INVALID_HANDLE_VALUE;
+
+    explicit LockedFile(const std::string& path) : path(path) {
+        for (;;) {
+            // FILE_SHARE_DELETE lets compaction rename over the file while
+            // others have it open
+            h = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+            if (h == INVALID_HANDLE_VALUE) return;
+            OVERLAPPED ov = {};
+            LockFileEx(h, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &ov);
+            if (isCurrent()) return;
+            UnlockFileEx(h, 0, MAXDWORD, MAXDWORD, &ov);
+            CloseHandle(h);
+        }
+    }
+
+    // Whether h is still the file at path
+    bool isCurrent() const {
+        HANDLE now = CreateFileA(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                 NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (now == INVALID_HANDLE_VALUE) return false;
+        BY_HANDLE_FILE_INFORMATION a, b;
+        bool same = GetFileInformationByHandle(h, &a) && GetFileInformationByHandle(now, &b) &&
+                    a.dwVolumeSerialNumber == b.dwVolumeSerialNumber &&
+                    a.nFileIndexHigh == b.nFileIndexHigh && a.nFileIndexLow == b.nFileIndexLow;
+        CloseHandle(now);
+        return same;
+    }
+    ~LockedFile() {
+        if (h == INVALID_HANDLE_VALUE) return;
+        OVERLAPPED ov = {};
+        UnlockFileEx(h, 0, MAXDWORD, MAXDWORD, &ov);
+        CloseHandle(h);
+    }
+    bool ok() const { return h != INVALID_HANDLE_VALUE; }
+
+    size_t size() const {
+        LARGE_INTEGER sz;
+        return GetFileSizeEx(h, &sz) ? (size_t)sz.QuadPart : 0;
+    }
+
+    // Calls scan(data, len) over a read-only mapping of the file.
+    template <class Scan>
+    void map(Scan scan) const {
+        size_t len = size();
+        if (len == 0) return;
+        HANDLE m = CreateFileMappingA(h, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!m) return;
+        const char* data = static_cast<const char*>(MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0));
+        if (data) {
+            scan(data, len);
+            UnmapViewOfFile(data);
+        }
+        CloseHandle(m);
+    }
+
+    bool append(const std::string& bytes) {
+        LARGE_INTEGER zero = {};
+        if (!SetFilePointerEx(h, zero, NULL, FILE_END)) return false;
+        DWORD written = 0;
+        return WriteFile(h, bytes.data(), (DWORD)bytes.size(), &written, NULL) && written == bytes.size();
+    }
+
+    bool replace(const std::string& bytes) {
+        std::string temp = path + ".tmp";
+        HANDLE t = CreateFileA(temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (t == INVALID_HANDLE_VALUE) return false;
+        DWORD written = 0;
+        bool ok = WriteFile(t, bytes.data(), (DWORD)bytes.size(), &written, NULL) && written == bytes.size() &&
+                  FlushFileBuffers(t);
+        CloseHandle(t);
+        if (ok) ok = MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+        if (!ok) DeleteFileA(temp.c_str());
+        return ok;
+    }
+#else
+    int fd = -1;
+
+    explicit LockedFile(const std::string& path) : path(path) {
+        for (;;) {
+            fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0) return;
+            flock(fd, LOCK_EX);
+            struct stat held, now;
+            if (fstat(fd, &held) != 0 || stat(path.c_str(), &now) != 0) return;
+            if (held.st_dev == now.st_dev && held.st_ino == now.st_ino) return;
+            close(fd);
+        }
+    }
+    ~LockedFile() {
+        if (fd < 0) return;
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+    bool ok() const { return fd >= 0; }
+
+    size_t size() const {
+        struct stat st;
+        return fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+    }
+
+    template <class Scan>
+    void map(Scan scan) const {
+        size_t len = size();
+        if (len == 0) return;
+        void* data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) return;
+        scan(static_cast<const char*>(data), len);
+        munmap(data, len);
+    }
+
+    static bool writeAll(int fd, const std::string& bytes) {
+        const char* p = bytes.data();
+        size_t left = bytes.size();
+        while (left > 0) {
+            ssize_t n = write(fd, p, left);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            p += n;
+            left -= n;
+        }
+        return true;
+    }
+
+    // O_APPEND: each write lands at the current end of the file.
+    bool append(const std::string& bytes) {
+        return writeAll(fd, bytes);
+    }
+
+    bool replace(const std::string& bytes) {
+        std::string temp = path + ".tmp";
+        int t = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (t < 0) return false;
+        bool ok = writeAll(t, bytes) && fsync(t) == 0;
+        if (close(t) != 0) ok = false;
+        if (ok) ok = rename(temp.c_str(), path.c_str()) == 0;
+        if (!ok) unlink(temp.c_str());
+        return ok;
+    }
+#endif
+};
+
+}
+
+void HistoryStore::init(const std::string& exePath) {
+    // Absolute: the shell changes directory right after this
+    filePath = (fs::absolute(exePath).parent_path() / "history.min").string();
+
+    entries.clear();
+    index.clear();
+    useCounts.clear();
+
+    size_t lines = 0;
+    {
+        LockedFile file(filePath);
+        if (!file.ok()) return;
+        file.map([&](const char* data, size_t len) { ingest(data, len, lines); });
+    }
+    rev++;
+
+    if (lines >= COMPACT_MIN_LINES && lines >= 2 * index.size()) compact();
+}
+
+// Reads complete lines; a trailing partial line is an append still in
+// progress elsewhere and is skipped.
+void HistoryStore::ingest(const char* data, size_t len, size_t& lines) {
+    const char* p = data;
+    const char* end = data + len;
+    while (p < end) {
+        const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!nl) break;
+        const char* stop = (nl > p && nl[-1] == '\r') ? nl - 1 : nl; // Files written on Windows
+        if (stop > p) {
+            insert(std::string_view(p, stop - p));
+            lines++;
+        }
+        p = nl + 1;
+    }
+}
+
+void HistoryStore::insert(std::string_view cmd) {
+    uint32_t count = 1;
+    auto it = index.find(cmd);
+    if (it != index.end()) {
+        size_t old = it->second;
+        count += useCounts[old];
+        index.erase(it);
+        std::string().swap(entries[old]);
+    }
+    entries.emplace_back(cmd);
+    useCounts.push_back(count);
+    index.emplace(std::string_view(entries.back()), entries.size() - 1);
+}
+
+void HistoryStore::add(const std::string& cmd) {
+    if (cmd.empty() || cmd.find('\n') != std::string::npos) return;
+
+    auto it = index.find(cmd);
+    if (it != index.end() && it->second == entries.size() - 1) return; // Same as the last one
+
+    insert(cmd);
+    rev++;
+    appendLine(cmd + "\n");
+}
+
+bool HistoryStore::appendLine(const std::string& line) {
+    if (filePath.empty()) return false;
+    LockedFile file(filePath);
+    return file.ok() && file.append(line);
+}
+
+// Rewrites the file with one line per command, re-reading it under the lock
+// so lines appended by other processes since init() are kept.
+void HistoryStore::compact() {
+    LockedFile file(filePath);
+    if (!file.ok()) return;
+
+    entries.clear();
+    index.clear();
+    useCounts.clear();
+    size_t lines = 0;
+    file.map([&](const char* data, size_t len) { ingest(data, len, lines); });
+
+    std::string out;
+    std::deque<std::string> kept;
+    std::vector<uint32_t> keptUses;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].empty()) continue;
+        out += entries[i];
+        out += '\n';
+        kept.push_back(std::move(entries[i]));
+        keptUses.push_back(useCounts[i]);
+    }
+    file.replace(out);
+
+    entries.swap(kept);
+    useCounts.swap(keptUses);
+    index.clear();
+    for (size_t i = 0; i < entries.size(); ++i) index.emplace(std::string_view(entries[i]), i);
+    rev++;
+}
@@ -0,0 +1,50 @@
+#ifndef HISTORY_STORE_HPP
+#define HISTORY_STORE_HPP
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+// Command history shared by every pane, kept in history.min next to the
+// executable: one command per line, appended as it is run.
+//
+// Each command is kept once. Running it again moves it to the end, in
+// memory through a hash index and on disk as another appended line; the
+// file is compacted back to one line per command when loading finds it
+// mostly duplicates. Appends and compaction take a file lock, so several
+// MinSh processes can share the file.
+class HistoryStore {
+public:
+    static void init(const std::string& exePath);
+    static void add(const std::string& cmd);
+
+    // Entries oldest first. Slots of commands that were run again later
+    // are left empty, so indices stay valid while the store grows.
+    static size_t size() { return entries.size(); }
+    static const std::string& at(size_t i) { return entries[i]; }
+    static size_t liveCount() { return index.size(); }
+    // How many times the command in slot i was run, as far as the file
+    // remembers (compaction folds repeats into one line).
+    static uint32_t uses(size_t i) { return useCounts[i]; }
+
+    // Bumped on every change, for caches built on top of the history.
+    static uint64_t revision() { return rev; }
+
+private:
+    static std::string filePath;
+    static std::deque<std::string> entries; // deque: elements never move
+    static std::unordered_map<std::string_view, size_t> index;
+    static std::vector<uint32_t> useCounts; // Parallel to entries
+    static uint64_t rev;
+
+    static void ingest(const char* data, size_t len, size_t& lines);
+    static void insert(std::string_view cmd);
+    static void compact();
+    static bool appendLine(const std::string& line);
+};
+
+#endif // HISTORY_STORE_HPP
@@ -0,0 +1,106 @@
+#include "HistorySuggest.hpp"
+#include "HistoryStore.hpp"
+#include <algorithm>
+#include <cstring>
+
+bool HistorySuggest::built = false;
+size_t HistorySuggest::indexed = 0;
+std::vector<HistorySuggest::Node> HistorySuggest::nodes;
+
+uint32_t HistorySuggest::child(uint32_t node, char c) {
+    const Node& n = nodes[node];
+    const void* hit = memchr(n.firsts.data(), c, n.firsts.size());
+    return hit ? n.children[static_cast<const char*>(hit) - n.firsts.data()] : 0;
+}
+
+uint64_t HistorySuggest::rank(uint32_t node) {
+    size_t entry = nodes[node].entry;
+    return entry + FREQUENCY_WEIGHT * (HistoryStore::uses(entry) - 1);
+}
+
+// A command's rank only grows (running it again moves it to a newer slot
+// with one more use), so raising `best` along its path keeps every
+// subtree's best correct.
+void HistorySuggest::insert(const std::string& cmd, size_t entry) {
+    std::vector<uint32_t> path = { 0 };
+    uint32_t cur = 0;
+    size_t pos = 0;
+    while (pos < cmd.size()) {
+        uint32_t next = child(cur, cmd[pos]);
+        if (!next) {
+            next = (uint32_t)nodes.size();
+            nodes.emplace_back();
+            nodes[next].label = cmd.substr(pos);
+            nodes[cur].children.push_back(next);
+            nodes[cur].firsts += cmd[pos];
+            path.push_back(next);
+            cur = next;
+            break;
+        }
+
+        const std::string& label = nodes[next].label;
+        size_t common = 0;
+        size_t limit = std::min(label.size(), cmd.size() - pos);
+        while (common < limit && label[common] == cmd[pos + common]) common++;
+
+        if (common < label.size()) {
+            // Split the edge; the upper half takes over next's place
+            uint32_t mid = (uint32_t)nodes.size();
+            nodes.emplace_back();
+            nodes[mid].label = nodes[next].label.substr(0, common);
+            nodes[mid].children.push_back(next);
+            nodes[mid].firsts += nodes[next].label[common];
+            nodes[mid].best = nodes[next].best;
+            nodes[next].label.erase(0, common);
+            std::replace(nodes[cur].children.begin(), nodes[cur].children.end(), next, mid);
+            next = mid;
+        }
+        path.push_back(next);
+        cur = next;
+        pos += common;
+    }
+
+    nodes[cur].entry = (int32_t)entry;
+    uint64_t r = rank(cur);
+    for (uint32_t n : path) {
+        if (!nodes[n].best || rank(nodes[n].best) < r) nodes[n].best = cur;
+    }
+}
+
+void HistorySuggest::update() {
+    if (!built) return;
+    // The store only shrinks when it is reloaded; start over then.
+    if (HistoryStore::size() < indexed || nodes.empty()) {
+        nodes.assign(1, Node());
+        indexed = 0;
+    }
+    for (; indexed < HistoryStore::size(); ++indexed) {
+        const std::string& cmd = HistoryStore::at(indexed);
+        if (!cmd.empty()) insert(cmd, indexed);
+    }
+}
+
+std::string HistorySuggest::complete(const std::string& prefix) {
+    if (!built) {
+        built = true;
+        update();
+    }
+    if (prefix.empty()) return "";
+
+    uint32_t cur = 0;
+    size_t pos = 0;
+    while (pos < prefix.size()) {
+        uint32_t next = child(cur, prefix[pos]);
+        if (!next) return "";
+        const std::string& label = nodes[next].label;
+        size_t n = std::min(label.size(), prefix.size() - pos);
+        if (label.compare(0, n, prefix, pos, n) != 0) return "";
+        pos += n;
+        cur = next;
+    }
+
+    uint32_t best = nodes[cur].best;
+    if (!best) return "";
+    const std::string& cmd = HistoryStore::at(nodes[best].entry);
+    return cmd.size() > prefix.size() ? cmd.substr(prefix.size()) : "";
+}
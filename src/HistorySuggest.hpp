@@ -0,0 +1,40 @@
+#ifndef HISTORY_SUGGEST_HPP
+#define HISTORY_SUGGEST_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Inline suggestions for the prompt: a radix tree over HistoryStore where
+// every node remembers the best ranked command below it, so completing a
+// prefix only walks the prefix. Ranked by recency, with each repeated use
+// counting as FREQUENCY_WEIGHT commands newer. Built on first use and
+// extended as commands are added.
+class HistorySuggest {
+public:
+    // Rest of the best command starting with prefix, or "" when none.
+    static std::string complete(const std::string& prefix);
+    // Adds entries stored since the last call; no-op until first use.
+    static void update();
+
+private:
+    static const uint64_t FREQUENCY_WEIGHT = 32;
+
+    struct Node {
+        std::string label;              // Edge from the parent
+        std::vector<uint32_t> children;
+        std::string firsts;             // First label byte of each child, for memchr
+        int32_t entry = -1;             // HistoryStore index of the command ending here
+        uint32_t best = 0;              // Best command node in this subtree, 0 = none
+    };
+
+    static bool built;
+    static size_t indexed;
+    static std::vector<Node> nodes; // nodes[0] is the root
+
+    static uint32_t child(uint32_t node, char c);
+    static uint64_t rank(uint32_t node);
+    static void insert(const std::string& cmd, size_t entry);
+};
+
+#endif // HISTORY_SUGGEST_HPP
@@ -1,13 +1,18 @@
 #ifndef INPUT_HPP
 #define INPUT_HPP
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <unistd.h>
+#endif
 #include <string>
 #include "Panes.hpp"
 #include <algorithm>
 
 namespace Input {
 
+#ifdef _WIN32
     inline void handleClipboardCopy(Pane& pane) {
         if (!OpenClipboard(NULL)) return;
         EmptyClipboard();
@@ -49,6 +54,32 @@ namespace Input {
         }
         CloseClipboard();
     }
+#else
+    // Terminals own the clipboard here: copying goes out as an OSC 52
+    // request and pasted text arrives as ordinary input.
+    inline void handleClipboardCopy(Pane& pane) {
+        if (!pane.hasSelection || pane.currentInput.empty()) return;
+
+        static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        const std::string& text = pane.currentInput;
+        std::string seq = "\033]52;c;";
+        for (size_t i = 0; i < text.size(); i += 3) {
+            unsigned int n = (unsigned char)text[i] << 16;
+            if (i + 1 < text.size()) n |= (unsigned char)text[i + 1] << 8;
+            if (i + 2 < text.size()) n |= (unsigned char)text[i + 2];
+            seq += table[(n >> 18) & 63];
+            seq += table[(n >> 12) & 63];
+            seq += (i + 1 < text.size()) ? table[(n >> 6) & 63] : '=';
+            seq += (i + 2 < text.size()) ? table[n & 63] : '=';
+        }
+        seq += "\a";
+        if (write(STDOUT_FILENO, seq.data(), seq.size()) < 0) {
+            // Nothing useful to do without a terminal
+        }
+    }
+
+    inline void handleClipboardPaste(Pane&) {}
+#endif
 
     inline void handleSelectAll(Pane& pane) {
         pane.hasSelection = true;
@@ -1,19 +1,134 @@
 #ifndef INTERRUPTS_HPP
 #define INTERRUPTS_HPP
 
-#include <windows.h>
 #include "Panes.hpp"
 #include "Input.hpp"
+#include "Terminal.hpp"
+#include "HistoryStore.hpp"
+#include "HistorySearch.hpp"
+#include "HistorySuggest.hpp"
+#include "Completion.hpp"
 
 namespace Interrupts {
 
-    inline void processKey(Pane& pane, KEY_EVENT_RECORD& ker) {
-        if (!ker.bKeyDown) return;
+    // ---- Reverse history search (Ctrl+R) ----
 
-        bool ctrl = (ker.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) != 0;
-        bool shift = (ker.dwControlKeyState & (SHIFT_PRESSED)) != 0;
-        char c = ker.uChar.AsciiChar;
-        WORD vk = ker.wVirtualKeyCode;
+    inline void showSearch(Pane& pane) {
+        std::string line = pane.searchFailed ? "(failed reverse-i-search)`" : "(reverse-i-search)`";
+        line += pane.searchQuery + "': ";
+        if (pane.searchMatch >= 0) line += HistoryStore::at(pane.searchMatch);
+        pane.redrawInputArea(pane.searchShown, pane.searchShown, line);
+        pane.searchShown = line.length();
+    }
+
+    inline void startSearch(Pane& pane) {
+        pane.searching = true;
+        pane.searchQuery.clear();
+        pane.searchMatch = -1;
+        pane.searchFailed = false;
+        pane.searchSavedInput = pane.currentInput;
+        // Clear the input line; showSearch draws from the prompt on
+        pane.redrawInputArea(pane.inputCursor, pane.currentInput.length(), "");
+        pane.searchShown = 0;
+        showSearch(pane);
+    }
+
+    // Leaves search mode with text as the input line.
+    inline void endSearch(Pane& pane, const std::string& text) {
+        pane.redrawInputArea(pane.searchShown, pane.searchShown, text);
+        pane.searching = false;
+        pane.searchShown = 0;
+        pane.currentInput = text;
+        pane.inputCursor = text.length();
+        pane.hasSelection = false;
+        pane.session->resetHistoryIndex();
+    }
+
+    // Looks for the query in entries older than `before`; a miss keeps the
+    // previous match on screen, marked as failed.
+    inline void runSearch(Pane& pane, int before) {
+        int found = HistorySearch::find(pane.searchQuery, before);
+        pane.searchFailed = found < 0 && !pane.searchQuery.empty();
+        if (found >= 0 || pane.searchQuery.empty()) pane.searchMatch = found;
+    }
+
+    // Returns true when the key should still go to the line editor: keys
+    // other than the search ones accept the match first.
+    inline bool processSearchKey(Pane& pane, const KeyEvent& key) {
+        int vk = key.key;
+        char c = key.ch;
+        int newest = (int)HistoryStore::size();
+
+        if (key.ctrl) {
+            if (vk == 'R') {
+                if (pane.searchQuery.empty()) return false;
+                runSearch(pane, pane.searchMatch >= 0 ? pane.searchMatch : newest);
+                showSearch(pane);
+            } else if (vk == 'G') {
+                endSearch(pane, pane.searchSavedInput);
+            }
+            return false;
+        }
+
+        if (vk == KEY_BACKSPACE) {
+            if (!pane.searchQuery.empty()) pane.searchQuery.pop_back();
+            runSearch(pane, newest);
+            showSearch(pane);
+            return false;
+        }
+        if (vk != KEY_ENTER && c >= 32) {
+            pane.searchQuery += c;
+            // The current match may still contain the longer query
+            runSearch(pane, pane.searchMatch >= 0 ? pane.searchMatch + 1 : newest);
+            showSearch(pane);
+            return false;
+        }
+
+        endSearch(pane, pane.searchMatch >= 0 ? HistoryStore::at(pane.searchMatch) : pane.searchSavedInput);
+        // Enter runs the accepted line (Shell sees the key next); Escape only accepts it
+        return vk != KEY_ENTER && vk != KEY_ESCAPE && c != '\r';
+    }
+
+    // Tab: completes the word before the cursor, as far as the candidates
+    // agree. Returns them when that adds nothing, for the caller to list.
+    inline std::vector<std::string> completeWord(Pane& pane) {
+        pane.hideSuggestion();
+        std::string line = pane.currentInput.substr(0, pane.inputCursor);
+        size_t start = 0;
+        std::vector<std::string> matches = Completion::complete(line, pane.session->getCwd(), start);
+        if (matches.empty()) return matches;
+
+        std::string word = line.substr(start);
+        std::string text = matches[0];
+        if (matches.size() == 1) {
+            if (text.back() != '/') {
+                if (text[0] == '"') text += '"';
+                text += ' ';
+            }
+        } else {
+            size_t common = text.size();
+            for (const std::string& m : matches) {
+                size_t n = 0;
+                while (n < common && n < m.size() && m[n] == text[n]) n++;
+                common = n;
+            }
+            if (common <= word.size()) return matches;
+            text.resize(common);
+        }
+
+        for (size_t i = 0; i < word.size(); ++i) pane.deleteChar();
+        for (char ch : text) pane.insertChar(ch);
+        pane.hasSelection = false;
+        return {};
+    }
+
+    inline void editLine(Pane& pane, const KeyEvent& key) {
+        if (pane.searching && !processSearchKey(pane, key)) return;
+
+        bool ctrl = key.ctrl;
+        bool shift = key.shift;
+        char c = key.ch;
+        int vk = key.key;
 
         if (ctrl) {
             if (vk == 'V') {
@@ -22,23 +137,25 @@ namespace Interrupts {
                 Input::handleSelectAll(pane);
             } else if (vk == 'L') {
                  pane.repaint();
+            } else if (vk == 'R') {
+                 startSearch(pane);
             }
             return; 
         }
 
-        if (vk == VK_LEFT) {
+        if (vk == KEY_LEFT) {
             pane.moveCursor(-1);
             if (!shift) pane.hasSelection = false;
-        } else if (vk == VK_RIGHT) {
+        } else if (vk == KEY_RIGHT) {
              pane.moveCursor(1);
              if (!shift) pane.hasSelection = false;
-        } else if (vk == VK_HOME) {
+        } else if (vk == KEY_HOME) {
              pane.inputCursor = 0;
              if (!shift) pane.hasSelection = false;
-        } else if (vk == VK_END) {
+        } else if (vk == KEY_END) {
              pane.inputCursor = pane.currentInput.length();
              if (!shift) pane.hasSelection = false;
-        } else if (vk == VK_UP) {
+        } else if (vk == KEY_UP) {
              std::string prev = pane.session->historyUp(pane.currentInput);
              if (!prev.empty()) {
                  while(pane.currentInput.length() > 0) {
@@ -49,7 +166,7 @@ namespace Interrupts {
                  pane.write(prev);
                  pane.inputCursor = prev.length();
              }
-        } else if (vk == VK_DOWN) {
+        } else if (vk == KEY_DOWN) {
              std::string next = pane.session->historyDown();
              while(pane.currentInput.length() > 0) {
                  pane.inputCursor = pane.currentInput.length();
@@ -58,10 +175,10 @@ namespace Interrupts {
              pane.currentInput = next;
              pane.write(next);
              pane.inputCursor = next.length();
-        } else if (vk == VK_BACK) {
+        } else if (vk == KEY_BACKSPACE) {
             pane.deleteChar();
             pane.hasSelection = false;
-        } else if (vk == VK_DELETE) {
+        } else if (vk == KEY_DELETE) {
              pane.deleteCharForward();
              pane.hasSelection = false;
         } else if (c >= 32) {
@@ -69,6 +186,33 @@ namespace Interrupts {
              pane.hasSelection = false;
         }
     }
+
+    inline void processKey(Pane& pane, const KeyEvent& key) {
+        if (!key.down) return;
+        if (key.key == KEY_NONE && key.ch == 0) return; // Not a key the line editor uses
+
+        // Right/End at the end of the line take the suggestion
+        std::string accepted;
+        if (!key.ctrl && (key.key == KEY_RIGHT || key.key == KEY_END) &&
+            pane.inputCursor == (int)pane.currentInput.length()) {
+            accepted = pane.suggestion;
+        }
+        pane.hideSuggestion();
+
+        if (!accepted.empty()) {
+            for (char ch : accepted) pane.insertChar(ch);
+            pane.hasSelection = false;
+        } else {
+            editLine(pane, key);
+        }
+
+        // Enter is about to run the line
+        if (!pane.searching && key.ch != '\r' && !pane.currentInput.empty() &&
+            pane.inputCursor == (int)pane.currentInput.length()) {
+            std::string rest = HistorySuggest::complete(pane.currentInput);
+            if (!rest.empty()) pane.showSuggestion(rest);
+        }
+    }
 }
 
 #endif // INTERRUPTS_HPP
@@ -0,0 +1,51 @@
+#include "Job.hpp"
+#include "EventLoop.hpp"
+
+Job::Job(std::function<void(Job&)> body) : stop(false), done(false) {
+    worker = std::thread([this, body] {
+        try {
+            body(*this);
+        } catch (const std::exception& e) {
+            write("\033[31mMinsh: internal error: " + std::string(e.what()) + "\033[0m\n");
+        } catch (...) {
+            write("\033[31mMinsh: unknown internal error\033[0m\n");
+        }
+        done = true;
+        EventLoop::notify();
+    });
+}
+
+Job::~Job() {
+    cancel();
+    if (worker.joinable()) worker.join();
+}
+
+void Job::cancel() {
+    std::lock_guard<std::mutex> guard(lock);
+    stop = true;
+    drained.notify_all();
+}
+
+void Job::write(const std::string& text) {
+    if (text.empty()) return;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        // No waiting once cancelled: the body is about to return anyway
+        drained.wait(guard, [this] { return output.size() < MAX_BUFFERED || cancelled(); });
+        output += text;
+    }
+    EventLoop::notify();
+}
+
+std::string Job::take(size_t maxBytes) {
+    std::string result;
+    std::lock_guard<std::mutex> guard(lock);
+    if (output.size() <= maxBytes) {
+        result.swap(output);
+    } else {
+        result.assign(output, 0, maxBytes);
+        output.erase(0, maxBytes);
+    }
+    if (output.size() < MAX_BUFFERED) drained.notify_all();
+    return result;
+}
@@ -0,0 +1,42 @@
+#ifndef JOB_HPP
+#define JOB_HPP
+
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// A builtin running off the UI thread. The body gets the job to write its
+// output and to check for Ctrl+C; the main loop collects the output the
+// same way it does a child's. Output is bounded: writers block once
+// MAX_BUFFERED bytes are waiting, until the pane catches up.
+class Job {
+public:
+    explicit Job(std::function<void(Job&)> body);
+    ~Job(); // Cancels, then waits for the body to return
+    Job(const Job&) = delete;
+    Job& operator=(const Job&) = delete;
+
+    void cancel();
+    bool cancelled() const { return stop.load(std::memory_order_relaxed); }
+    bool finished() const { return done.load(); }
+
+    // Safe from any thread the body starts.
+    void write(const std::string& text);
+    // At most maxBytes of what was written, oldest first.
+    std::string take(size_t maxBytes);
+
+private:
+    static const size_t MAX_BUFFERED = 256 * 1024;
+
+    std::mutex lock;
+    std::condition_variable drained;
+    std::string output;
+    std::atomic<bool> stop;
+    std::atomic<bool> done;
+    std::thread worker;
+};
+
+#endif // JOB_HPP
@@ -1,6 +1,24 @@
 // Compile: Use CMake (mkdir build && cd build && cmake .. && cmake --build .)
 #include "Lexer.hpp"
 #include <sstream>
+#include <cctype>
+
+namespace {
+
+// Whether word is an unclosed -h( or -r( argument, whose text is a literal
+// or a regex: | < > in it belong to the pattern, not the command line.
+bool inPatternParens(const std::string& word) {
+    if (word.rfind("-h(", 0) != 0 && word.rfind("-r(", 0) != 0) return false;
+    int depth = 0;
+    for (size_t i = 1; i < word.size(); ++i) {
+        if (word[i] == '\\') i++; // \( and \) are literal parens
+        else if (word[i] == '(') depth++;
+        else if (word[i] == ')') depth--;
+    }
+    return depth > 0;
+}
+
+}
 
 std::vector<Token> Lexer::tokenize(const std::string& input) {
     std::vector<Token> tokens;
@@ -29,6 +47,33 @@ std::vector<Token> Lexer::tokenize(const std::string& input) {
                 }
                 inQuotes = true;
                 quoteChar = c;
+            } else if ((c == '|' || c == '<' || c == '>') && inPatternParens(currentToken)) {
+                currentToken += c;
+            } else if (c == '|') {
+                if (!currentToken.empty()) {
+                    tokens.push_back({LexerTokenType::WORD, currentToken});
+                    currentToken.clear();
+                }
+                tokens.push_back({LexerTokenType::PIPE, "|"});
+            } else if (c == '>' || c == '<') {
+                // A lone digit right before the operator is the fd it applies to
+                std::string op;
+                if (currentToken.size() == 1 && std::isdigit((unsigned char)currentToken[0])) {
+                    op = currentToken;
+                } else if (!currentToken.empty()) {
+                    tokens.push_back({LexerTokenType::WORD, currentToken});
+                }
+                currentToken.clear();
+
+                op += c;
+                if (c == '>' && i + 1 < input.length() && input[i + 1] == '>') {
+                    op += '>';
+                    i++;
+                } else if (i + 2 < input.length() && input[i + 1] == '&' && std::isdigit((unsigned char)input[i + 2])) {
+                    op += input.substr(i + 1, 2);
+                    i += 2;
+                }
+                tokens.push_back({LexerTokenType::REDIRECT, op});
             } else if (std::isspace(c)) {
                 if (!currentToken.empty()) {
                     tokens.push_back({LexerTokenType::WORD, currentToken});
@@ -46,3 +91,66 @@ std::vector<Token> Lexer::tokenize(const std::string& input) {
 
     return tokens;
 }
+
+bool Lexer::hasOperators(const std::vector<Token>& tokens) {
+    for (const auto& token : tokens) {
+        if (token.type == LexerTokenType::PIPE || token.type == LexerTokenType::REDIRECT) return true;
+    }
+    return false;
+}
+
+bool Lexer::parsePipeline(const std::vector<Token>& tokens, std::vector<PipelineStage>& stages, std::string& error) {
+    stages.assign(1, PipelineStage());
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        const Token& token = tokens[i];
+        PipelineStage& stage = stages.back();
+
+        if (token.type == LexerTokenType::PIPE) {
+            if (stage.args.empty()) {
+                error = "syntax error near '|'";
+                return false;
+            }
+            stages.push_back(PipelineStage());
+        } else if (token.type == LexerTokenType::REDIRECT) {
+            const std::string& op = token.value;
+            size_t pos = 0;
+            Redirect r;
+            r.fd = (op.find('<') != std::string::npos) ? 0 : 1;
+            if (std::isdigit((unsigned char)op[0])) {
+                r.fd = op[0] - '0';
+                pos = 1;
+            }
+            std::string kind = op.substr(pos);
+            if (r.fd > 2) {
+                error = "only fds 0-2 can be redirected";
+                return false;
+            }
+
+            if (kind.size() == 3 && kind[1] == '&') {
+                r.dupOf = kind[2] - '0';
+                if (r.dupOf > 2) {
+                    error = "only fds 0-2 can be redirected";
+                    return false;
+                }
+            } else {
+                if (i + 1 >= tokens.size() || (tokens[i + 1].type != LexerTokenType::WORD &&
+                                                tokens[i + 1].type != LexerTokenType::STRING)) {
+                    error = "syntax error: '" + op + "' needs a file name";
+                    return false;
+                }
+                r.path = tokens[++i].value;
+                r.append = (kind == ">>");
+            }
+            stage.redirects.push_back(r);
+        } else {
+            stage.args.push_back(token.value);
+        }
+    }
+
+    if (stages.back().args.empty()) {
+        error = stages.size() > 1 ? "syntax error: '|' needs a command after it" : "syntax error: no command";
+        return false;
+    }
+    return true;
+}
@@ -7,6 +7,8 @@
 enum class LexerTokenType {
     WORD,
     STRING,
+    PIPE,     // |
+    REDIRECT, // <, >, >>, with an optional fd before (2>) or &fd after (2>&1)
     UNKNOWN
 };
 
@@ -15,9 +17,29 @@ struct Token {
     std::string value;
 };
 
+// A redirection of one of the standard fds, applied in the order written.
+struct Redirect {
+    int fd;               // 0, 1 or 2
+    int dupOf = -1;       // n>&m: fd becomes a copy of m
+    std::string path;     // Otherwise the file opened for it
+    bool append = false;  // >>
+};
+
+// One command of a pipeline.
+struct PipelineStage {
+    std::vector<std::string> args;
+    std::string program; // Executable for args[0], resolved by the caller
+    std::vector<Redirect> redirects;
+};
+
 class Lexer {
 public:
     static std::vector<Token> tokenize(const std::string& input);
+
+    // True when tokens use | or a redirection.
+    static bool hasOperators(const std::vector<Token>& tokens);
+    // Splits tokens into stages; false with error set on bad syntax.
+    static bool parsePipeline(const std::vector<Token>& tokens, std::vector<PipelineStage>& stages, std::string& error);
 };
 
 #endif // LEXER_HPP
@@ -0,0 +1,77 @@
+#include "MappedFile.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& path) {
+    hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return;
+    if (GetFileType(hFile) != FILE_TYPE_DISK) {
+        opened = true;
+        return;
+    }
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(hFile, &sz)) return;
+    length = (size_t)sz.QuadPart;
+    opened = true;
+    if (length == 0) return;
+
+    hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping) base = static_cast<const char*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (!base) {
+        opened = false;
+        length = 0;
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (base) UnmapViewOfFile(base);
+    if (hMapping) CloseHandle(hMapping);
+    if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+}
+
+void MappedFile::release(size_t, size_t) {
+    // The working set trimmer already drops clean file pages first
+}
+#else
+MappedFile::MappedFile(const std::string& path) {
+    // Non-blocking so a FIFO cannot stall the open; only regular files
+    // are mapped, anything else reads as empty
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && !S_ISDIR(st.st_mode)) {
+        length = S_ISREG(st.st_mode) ? (size_t)st.st_size : 0;
+        opened = true;
+        if (length > 0) {
+            void* p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                opened = false;
+                length = 0;
+            } else {
+                base = static_cast<const char*>(p);
+            }
+        }
+    }
+    close(fd); // The mapping keeps the file
+}
+
+MappedFile::~MappedFile() {
+    if (base) munmap(const_cast<char*>(base), length);
+}
+
+void MappedFile::release(size_t offset, size_t len) {
+    if (!base) return;
+    // madvise works on whole pages inside the range
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = (offset + page - 1) / page * page;
+    size_t end = (offset + len) / page * page;
+    if (end > start) madvise(const_cast<char*>(base) + start, end - start, MADV_DONTNEED);
+}
+#endif
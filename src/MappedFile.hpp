@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Read-only memory map of a whole file. Empty files, and anything that is
+// not a regular file (a FIFO, a device), map to size() 0 with a null data().
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return opened; }
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+
+    // Hints that [offset, offset + len) was read in order and will not be
+    // needed again, so long sequential scans keep a constant footprint.
+    void release(size_t offset, size_t len);
+
+private:
+    bool opened = false;
+    const char* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = NULL;
+#endif
+};
+
+#endif // MAPPED_FILE_HPP
@@ -0,0 +1,602 @@
+#include "Matcher.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <deque>
+
+namespace {
+
+// Bytes by how often they turn up in text and logs, most common first;
+// anything not listed counts as rarer than all of these.
+const char COMMON_BYTES[] = " etaoinsrhldcumfpgwybvkxjqz0123456789:/._-=,ETAOINSRHLDCUMFPGWYBVKXJQZ\t\"'()[]";
+
+int byteRank(unsigned char c) {
+    const char* p = static_cast<const char*>(memchr(COMMON_BYTES, c, sizeof(COMMON_BYTES) - 1));
+    return p ? (int)(sizeof(COMMON_BYTES) - (p - COMMON_BYTES)) : 0;
+}
+
+// Regex repeat counts above this are rejected; each one copies the atom.
+const int MAX_REPEAT = 1000;
+
+// Patterns compiling to more NFA states than this are rejected; nested
+// repeats multiply their counts.
+const size_t MAX_NFA_STATES = 100000;
+
+// Memory the lazily built DFA may hold before it is thrown away and built
+// again from the states in use.
+const size_t MAX_DFA_BYTES = 32 << 20;
+
+}
+
+void Matcher::addLiteral(const std::string& text) {
+    if (!text.empty() && text.find('\n') == std::string::npos) literals.push_back(text);
+}
+
+void Matcher::addRegex(const std::string& pattern) {
+    regexes.push_back(pattern);
+}
+
+bool Matcher::compile(std::string& error) {
+    if (!regexes.empty()) {
+        engine = REGEX;
+        nfa.clear();
+        dfa.clear();
+        dfaIndex.clear();
+        dfaBytes = 0;
+
+        // One alternation of every pattern; literals become plain byte runs
+        std::vector<Frag> alternatives;
+        for (const std::string& r : regexes) {
+            src = r;
+            pos = 0;
+            parseError.clear();
+            Frag f = parseAlternation();
+            if (parseError.empty() && pos < src.size()) parseError = "unexpected ')'";
+            if (!parseError.empty()) {
+                error = parseError + " in '" + r + "'";
+                return false;
+            }
+            alternatives.push_back(f);
+        }
+        for (const std::string& l : literals) {
+            Frag f = epsilon();
+            for (unsigned char c : l) {
+                std::bitset<SYMBOLS> set;
+                addChar(set, c);
+                f = concat(f, symbolSet(set));
+            }
+            alternatives.push_back(f);
+        }
+        if (nfa.size() > MAX_NFA_STATES) {
+            error = "patterns are too large";
+            return false;
+        }
+
+        int accept = newState();
+        nfa[accept].match = true;
+        nfaStart = alternatives[0].start;
+        patch(alternatives[0], accept);
+        for (size_t i = 1; i < alternatives.size(); ++i) {
+            int s = newState();
+            nfa[s].split = true;
+            nfa[s].out = nfaStart;
+            nfa[s].out1 = alternatives[i].start;
+            nfaStart = s;
+            patch(alternatives[i], accept);
+        }
+
+        std::vector<int> start = {nfaStart};
+        closure(start);
+        startMid = intern(start);
+        std::vector<int> bol = dfa[startMid].nfa;
+        int afterBol = step(startMid, BOL);
+        if (afterBol >= 0) bol.insert(bol.end(), dfa[afterBol].nfa.begin(), dfa[afterBol].nfa.end());
+        startBol = intern(bol);
+
+        for (int c = 0; c < 256; ++c) {
+            firstMid[c] = c != '\n' && step(startMid, c) >= 0;
+            firstBol[c] = c != '\n' && step(startBol, c) >= 0;
+        }
+        return true;
+    }
+
+    if (literals.empty()) {
+        engine = NONE;
+        return true;
+    }
+
+    if (literals.size() == 1 && !ignoreCase) {
+        engine = LITERAL;
+        const std::string& l = literals[0];
+        rareOffset = 0;
+        for (size_t i = 1; i < l.size(); ++i) {
+            if (byteRank(l[i]) < byteRank(l[rareOffset])) rareOffset = i;
+        }
+        return true;
+    }
+
+    // Aho-Corasick: a trie of the patterns, then breadth-first failure
+    // links folded into a full 256-way transition table.
+    engine = AHO_CORASICK;
+    acNext.assign(256, -1);
+    acLength.assign(1, 0);
+    acMaxLength = 0;
+    for (const std::string& l : literals) {
+        int s = 0;
+        for (unsigned char c : l) {
+            if (ignoreCase) c = (unsigned char)tolower(c);
+            if (acNext[s * 256 + c] < 0) {
+                acNext[s * 256 + c] = (int32_t)acLength.size();
+                acLength.push_back(0);
+                acNext.resize(acNext.size() + 256, -1);
+            }
+            s = acNext[s * 256 + c];
+        }
+        acLength[s] = std::max<uint32_t>(acLength[s], (uint32_t)l.size());
+        acMaxLength = std::max(acMaxLength, l.size());
+    }
+
+    std::vector<int32_t> fail(acLength.size(), 0);
+    std::deque<int> queue;
+    for (int c = 0; c < 256; ++c) {
+        int32_t& t = acNext[c];
+        if (t < 0) t = 0;
+        else queue.push_back(t);
+    }
+    while (!queue.empty()) {
+        int s = queue.front();
+        queue.pop_front();
+        // The longest match ending here may be a suffix pattern
+        acLength[s] = std::max(acLength[s], acLength[fail[s]]);
+        for (int c = 0; c < 256; ++c) {
+            int32_t& t = acNext[s * 256 + c];
+            if (t < 0) {
+                t = acNext[fail[s] * 256 + c];
+            } else {
+                fail[t] = acNext[fail[s] * 256 + c];
+                queue.push_back(t);
+            }
+        }
+    }
+
+    if (ignoreCase) {
+        size_t states = acLength.size();
+        for (size_t s = 0; s < states; ++s) {
+            for (int c = 'A'; c <= 'Z'; ++c) acNext[s * 256 + c] = acNext[s * 256 + (c - 'A' + 'a')];
+        }
+    }
+    for (int c = 0; c < 256; ++c) acFirst[c] = acNext[c] != 0;
+    return true;
+}
+
+void Matcher::scan(const char* data, size_t len, const std::function<void(size_t, size_t)>& span) {
+    switch (engine) {
+        case LITERAL: scanLiteral(data, len, span); break;
+        case AHO_CORASICK: scanAhoCorasick(data, len, span); break;
+        case REGEX: scanRegex(data, len, span); break;
+        case NONE: break;
+    }
+}
+
+// memchr for the pattern's rarest byte, then compare the whole pattern
+// around each hit.
+void Matcher::scanLiteral(const char* data, size_t len, const std::function<void(size_t, size_t)>& span) {
+    const std::string& l = literals[0];
+    if (l.size() > len) return;
+    const char rare = l[rareOffset];
+    const char* p = data + rareOffset;
+    const char* last = data + len - l.size() + rareOffset; // Last place rare can sit
+    while (p <= last) {
+        p = static_cast<const char*>(memchr(p, rare, last - p + 1));
+        if (!p) return;
+        const char* start = p - rareOffset;
+        if (memcmp(start, l.data(), l.size()) == 0) {
+            span(start - data, start - data + l.size());
+            p += l.size();
+        } else {
+            p++;
+        }
+    }
+}
+
+// Reports the union of every pattern occurrence. Spans are held back until
+// the scan is far enough past them that no later, longer match can reach
+// back into them.
+void Matcher::scanAhoCorasick(const char* data, size_t len, const std::function<void(size_t, size_t)>& span) {
+    const int32_t* next = acNext.data();
+    const uint32_t* length = acLength.data();
+    std::vector<std::pair<size_t, size_t>> pending; // Disjoint, in order, from `head`
+    size_t head = 0;
+    int32_t s = 0;
+    for (size_t i = 0; i < len; ++i) {
+        // At the root, skip bytes that cannot begin a pattern without
+        // walking the table
+        if (s == 0) {
+            while (i < len && !acFirst[(unsigned char)data[i]]) i++;
+            if (i == len) break;
+        }
+        s = next[s * 256 + (unsigned char)data[i]];
+        uint32_t l = length[s];
+        if (l != 0) {
+            size_t start = i + 1 - l;
+            while (pending.size() > head && pending.back().second >= start) {
+                start = std::min(start, pending.back().first);
+                pending.pop_back();
+            }
+            pending.emplace_back(start, i + 1);
+        }
+        if (pending.size() > head && pending[head].second + acMaxLength <= i + 1) {
+            do {
+                span(pending[head].first, pending[head].second);
+                head++;
+            } while (pending.size() > head && pending[head].second + acMaxLength <= i + 1);
+            if (head == pending.size()) {
+                pending.clear();
+                head = 0;
+            }
+        }
+    }
+    for (; head < pending.size(); ++head) span(pending[head].first, pending[head].second);
+}
+
+// Leftmost-longest: from each position that can begin a match, run the
+// DFA as far as it stays alive and take the longest accepted prefix.
+void Matcher::scanRegex(const char* data, size_t len, const std::function<void(size_t, size_t)>& span) {
+    size_t i = 0;
+    while (i < len) {
+        bool bol = i == 0 || data[i - 1] == '\n';
+        if (!(bol ? firstBol : firstMid)[(unsigned char)data[i]]) {
+            i++;
+            continue;
+        }
+        size_t end = longestAt(data, len, i, bol);
+        if (end > i) {
+            span(i, end);
+            i = end;
+        } else {
+            i++;
+        }
+    }
+}
+
+size_t Matcher::longestAt(const char* data, size_t len, size_t at, bool bol) {
+    int d = bol ? startBol : startMid;
+    size_t best = at;
+    for (size_t i = at; i < len && data[i] != '\n'; ++i) {
+        d = step(d, (unsigned char)data[i]);
+        if (d < 0) break;
+        if (dfa[d].accept) {
+            best = i + 1;
+        } else if (i + 1 == len || data[i + 1] == '\n') {
+            int e = step(d, EOL);
+            if (e >= 0 && dfa[e].accept) best = i + 1;
+        }
+    }
+    return best;
+}
+
+int Matcher::newState() {
+    if (nfa.size() >= MAX_NFA_STATES && parseError.empty()) parseError = "pattern is too large";
+    nfa.emplace_back();
+    return (int)nfa.size() - 1;
+}
+
+void Matcher::patch(const Frag& f, int target) {
+    for (const auto& o : f.outs) {
+        if (o.second == 0) nfa[o.first].out = target;
+        else nfa[o.first].out1 = target;
+    }
+}
+
+Matcher::Frag Matcher::epsilon() {
+    int s = newState();
+    nfa[s].split = true;
+    return {s, {{s, 0}}};
+}
+
+Matcher::Frag Matcher::symbolSet(const std::bitset<SYMBOLS>& set) {
+    int s = newState();
+    nfa[s].set = set;
+    return {s, {{s, 0}}};
+}
+
+Matcher::Frag Matcher::concat(Frag a, Frag b) {
+    patch(a, b.start);
+    return {a.start, std::move(b.outs)};
+}
+
+Matcher::Frag Matcher::parseAlternation() {
+    Frag f = parseConcat();
+    while (parseError.empty() && pos < src.size() && src[pos] == '|') {
+        pos++;
+        Frag g = parseConcat();
+        int s = newState();
+        nfa[s].split = true;
+        nfa[s].out = f.start;
+        nfa[s].out1 = g.start;
+        f.outs.insert(f.outs.end(), g.outs.begin(), g.outs.end());
+        f.start = s;
+    }
+    return f;
+}
+
+Matcher::Frag Matcher::parseConcat() {
+    Frag f = epsilon();
+    while (parseError.empty() && pos < src.size() && src[pos] != '|' && src[pos] != ')') {
+        f = concat(f, parseRepeat());
+    }
+    return f;
+}
+
+Matcher::Frag Matcher::parseRepeat() {
+    size_t atomPos = pos;
+    Frag f = parseAtom();
+    while (parseError.empty() && pos < src.size()) {
+        char q = src[pos];
+        if (q == '*' || q == '+' || q == '?') {
+            pos++;
+            int s = newState();
+            nfa[s].split = true;
+            nfa[s].out = f.start;
+            if (q == '*') {
+                patch(f, s);
+                f = {s, {{s, 1}}};
+            } else if (q == '+') {
+                patch(f, s);
+                f = {f.start, {{s, 1}}};
+            } else {
+                f.outs.push_back({s, 1});
+                f.start = s;
+            }
+            continue;
+        }
+        if (q != '{') break;
+
+        // {m}, {m,} or {m,n}: re-parse the atom for each copy
+        size_t close = src.find('}', pos);
+        if (close == std::string::npos) {
+            parseError = "missing '}'";
+            break;
+        }
+        std::string range = src.substr(pos + 1, close - pos - 1);
+        size_t comma = range.find(',');
+        std::string lo = range.substr(0, comma);
+        std::string hi = comma == std::string::npos ? lo : range.substr(comma + 1);
+        bool digits = !lo.empty() && lo.size() <= 4 && hi.size() <= 4 &&
+                      std::all_of(lo.begin(), lo.end(), ::isdigit) && std::all_of(hi.begin(), hi.end(), ::isdigit);
+        int m = digits ? std::stoi(lo) : 0;
+        int n = digits && !hi.empty() ? std::stoi(hi) : -1;
+        if (!digits || m > MAX_REPEAT || n > MAX_REPEAT || (n >= 0 && n < m)) {
+            parseError = "bad repeat '{" + range + "}'";
+            break;
+        }
+        size_t after = close + 1;
+        auto copy = [&]() {
+            pos = atomPos;
+            return parseAtom();
+        };
+        Frag r = epsilon();
+        for (int k = 0; k < m && parseError.empty(); ++k) r = concat(r, copy());
+        if (n < 0) {
+            Frag c = copy();
+            int s = newState();
+            nfa[s].split = true;
+            nfa[s].out = c.start;
+            patch(c, s);
+            r = concat(r, {s, {{s, 1}}});
+        } else {
+            for (int k = m; k < n && parseError.empty(); ++k) {
+                Frag c = copy();
+                int s = newState();
+                nfa[s].split = true;
+                nfa[s].out = c.start;
+                c.outs.push_back({s, 1});
+                c.start = s;
+                r = concat(r, c);
+            }
+        }
+        pos = after;
+        f = r;
+    }
+    return f;
+}
+
+Matcher::Frag Matcher::parseAtom() {
+    std::bitset<SYMBOLS> set;
+    char c = src[pos++];
+    switch (c) {
+        case '(': {
+            Frag f = parseAlternation();
+            if (pos >= src.size() || src[pos] != ')') {
+                if (parseError.empty()) parseError = "missing ')'";
+                return f;
+            }
+            pos++;
+            return f;
+        }
+        case '[':
+            if (!parseClass(set)) return epsilon();
+            break;
+        case '.':
+            set.set();
+            set.reset('\n');
+            set.reset(BOL);
+            set.reset(EOL);
+            break;
+        case '^':
+            set.set(BOL);
+            break;
+        case '$':
+            set.set(EOL);
+            break;
+        case '\\':
+            if (pos >= src.size()) {
+                parseError = "trailing '\\'";
+                return epsilon();
+            }
+            addEscape(set, src[pos++]);
+            break;
+        case '*': case '+': case '?': case '{':
+            parseError = std::string("nothing to repeat before '") + c + "'";
+            return epsilon();
+        default:
+            addChar(set, (unsigned char)c);
+            break;
+    }
+    return symbolSet(set);
+}
+
+// After the '['; consumes through the closing ']'.
+bool Matcher::parseClass(std::bitset<SYMBOLS>& set) {
+    bool negate = pos < src.size() && src[pos] == '^';
+    if (negate) pos++;
+    bool first = true;
+    while (pos < src.size() && (src[pos] != ']' || first)) {
+        first = false;
+        unsigned char lo = (unsigned char)src[pos++];
+        if (lo == '\\' && pos < src.size()) {
+            char e = src[pos++];
+            if (isalpha((unsigned char)e)) {
+                addEscape(set, e);
+                continue;
+            }
+            lo = (unsigned char)e;
+        }
+        if (pos + 1 < src.size() && src[pos] == '-' && src[pos + 1] != ']') {
+            unsigned char hi = (unsigned char)src[pos + 1];
+            pos += 2;
+            if (hi < lo) {
+                parseError = "bad range in '[...]'";
+                return false;
+            }
+            for (int k = lo; k <= hi; ++k) addChar(set, (unsigned char)k);
+        } else {
+            addChar(set, lo);
+        }
+    }
+    if (pos >= src.size()) {
+        parseError = "missing ']'";
+        return false;
+    }
+    pos++;
+    if (negate) {
+        for (int k = 0; k < 256; ++k) set.flip(k);
+        // Case folding has to follow the negation, not precede it
+        if (ignoreCase) {
+            for (int k = 'A'; k <= 'Z'; ++k) {
+                if (!set[k] || !set[k - 'A' + 'a']) {
+                    set.reset(k);
+                    set.reset(k - 'A' + 'a');
+                }
+            }
+        }
+    }
+    set.reset('\n');
+    return true;
+}
+
+void Matcher::addChar(std::bitset<SYMBOLS>& set, unsigned char c) const {
+    set.set(c);
+    if (ignoreCase && isalpha(c)) {
+        set.set((unsigned char)tolower(c));
+        set.set((unsigned char)toupper(c));
+    }
+}
+
+void Matcher::addEscape(std::bitset<SYMBOLS>& set, char e) {
+    if (e == 't') {
+        set.set('\t');
+        return;
+    }
+    std::bitset<SYMBOLS> cls;
+    switch (tolower((unsigned char)e)) {
+        case 'd':
+            for (int k = '0'; k <= '9'; ++k) cls.set(k);
+            break;
+        case 'w':
+            for (int k = 0; k < 256; ++k) {
+                if (isalnum(k) || k == '_') cls.set(k);
+            }
+            break;
+        case 's':
+            for (char k : std::string(" \t\r\f\v")) cls.set((unsigned char)k);
+            break;
+        default:
+            if (isalnum((unsigned char)e)) parseError = std::string("unsupported escape '\\") + e + "'";
+            else addChar(set, (unsigned char)e);
+            return;
+    }
+    if (isupper((unsigned char)e)) {
+        for (int k = 0; k < 256; ++k) cls.flip(k);
+        cls.reset('\n');
+    }
+    set |= cls;
+}
+
+// Adds every state reachable through splits; keeps the list sorted.
+void Matcher::closure(std::vector<int>& states) const {
+    std::vector<char> seen(nfa.size(), 0);
+    std::vector<int> stack(states.begin(), states.end());
+    states.clear();
+    while (!stack.empty()) {
+        int s = stack.back();
+        stack.pop_back();
+        if (s < 0 || seen[s]) continue;
+        seen[s] = 1;
+        states.push_back(s);
+        if (nfa[s].split) {
+            stack.push_back(nfa[s].out);
+            stack.push_back(nfa[s].out1);
+        }
+    }
+    std::sort(states.begin(), states.end());
+}
+
+int Matcher::intern(std::vector<int> states) {
+    std::sort(states.begin(), states.end());
+    states.erase(std::unique(states.begin(), states.end()), states.end());
+    if (states.empty()) return -1;
+    auto it = dfaIndex.find(states);
+    if (it != dfaIndex.end()) return it->second;
+
+    DfaState d;
+    d.accept = false;
+    for (int s : states) {
+        if (nfa[s].match) d.accept = true;
+    }
+    d.next.fill(-2);
+    d.nfa = states;
+    dfaBytes += sizeof(DfaState) + 2 * states.size() * sizeof(int); // The set is kept twice
+    dfa.push_back(std::move(d));
+    dfaIndex.emplace(std::move(states), (int)dfa.size() - 1);
+    return (int)dfa.size() - 1;
+}
+
+// Transition from DFA state d on symbol, built on first use.
+int Matcher::step(int d, int symbol) {
+    int t = dfa[d].next[symbol];
+    if (t != -2) return t;
+
+    std::vector<int> moved;
+    for (int s : dfa[d].nfa) {
+        if (!nfa[s].split && !nfa[s].match && nfa[s].set[symbol]) moved.push_back(nfa[s].out);
+    }
+    closure(moved);
+    if (dfaBytes >= MAX_DFA_BYTES) {
+        // Start the cache over from the start states and d. Callers only
+        // go on from the state returned, so the numbers they hold going
+        // stale is harmless.
+        std::vector<int> mid = dfa[startMid].nfa;
+        std::vector<int> bol = dfa[startBol].nfa;
+        std::vector<int> current = dfa[d].nfa;
+        dfa.clear();
+        dfaIndex.clear();
+        dfaBytes = 0;
+        startMid = intern(mid);
+        startBol = intern(bol);
+        d = intern(current);
+    }
+    t = intern(std::move(moved));
+    dfa[d].next[symbol] = t;
+    return t;
+}
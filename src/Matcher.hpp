@@ -0,0 +1,111 @@
+#ifndef MATCHER_HPP
+#define MATCHER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <array>
+#include <bitset>
+#include <functional>
+#include <cstdint>
+
+// Finds what `read -h` highlights in a block of text: any of several
+// literals and/or regular expressions, optionally ignoring ASCII case.
+//
+// The engine depends on the patterns: one literal is found with memchr on
+// its rarest byte, several literals with an Aho-Corasick automaton, and
+// regexes with a DFA built lazily from a Thompson NFA. Regexes support
+// . [] [^] \d \w \s (and uppercase), * + ? {m,n}, | and ( ), plus ^ and $
+// for line start and end. Matches never span a newline. Patterns are
+// limited in size and the DFA in memory; it is rebuilt when it fills up.
+class Matcher {
+public:
+    void addLiteral(const std::string& text);
+    void addRegex(const std::string& pattern);
+    void setIgnoreCase(bool on) { ignoreCase = on; }
+    bool empty() const { return literals.empty() && regexes.empty(); }
+
+    // Builds the engine; false with error set when a regex is malformed.
+    bool compile(std::string& error);
+
+    // Calls span(begin, end) for each match, in order and without overlap.
+    // data must start at a line start.
+    void scan(const char* data, size_t len, const std::function<void(size_t, size_t)>& span);
+
+private:
+    enum Engine { NONE, LITERAL, AHO_CORASICK, REGEX };
+    static const int BOL = 256;   // Symbol for line start (^)
+    static const int EOL = 257;   // Symbol for line end ($)
+    static const int SYMBOLS = 258;
+
+    std::vector<std::string> literals;
+    std::vector<std::string> regexes;
+    bool ignoreCase = false;
+    Engine engine = NONE;
+
+    // LITERAL
+    size_t rareOffset = 0;
+
+    // AHO_CORASICK: dense transition table, and per state the longest
+    // pattern ending there
+    std::vector<int32_t> acNext;
+    std::vector<uint32_t> acLength;
+    size_t acMaxLength = 0;
+    bool acFirst[256];  // Bytes that leave the root
+
+    // REGEX
+    struct NfaState {
+        std::bitset<SYMBOLS> set; // Consumed symbols, for non-split states
+        int out = -1;
+        int out1 = -1;
+        bool split = false;       // Epsilon moves to out and out1
+        bool match = false;
+    };
+    struct Frag {
+        int start;
+        std::vector<std::pair<int, int>> outs; // (state, 0 for out / 1 for out1) left dangling
+    };
+    struct DfaState {
+        std::vector<int> nfa;
+        bool accept;
+        std::array<int, SYMBOLS> next; // -2 not built yet, -1 dead
+    };
+    std::vector<NfaState> nfa;
+    int nfaStart = -1;
+    std::vector<DfaState> dfa;
+    std::map<std::vector<int>, int> dfaIndex;
+    size_t dfaBytes = 0; // Held by dfa and dfaIndex, roughly
+    int startMid = -1;
+    int startBol = -1;
+    bool firstMid[256];
+    bool firstBol[256];
+
+    // Regex parser state
+    std::string src;
+    size_t pos = 0;
+    std::string parseError;
+
+    int newState();
+    void patch(const Frag& f, int target);
+    Frag epsilon();
+    Frag symbolSet(const std::bitset<SYMBOLS>& set);
+    Frag concat(Frag a, Frag b);
+    Frag parseAlternation();
+    Frag parseConcat();
+    Frag parseRepeat();
+    Frag parseAtom();
+    bool parseClass(std::bitset<SYMBOLS>& set);
+    void addChar(std::bitset<SYMBOLS>& set, unsigned char c) const;
+    void addEscape(std::bitset<SYMBOLS>& set, char e);
+
+    void closure(std::vector<int>& states) const;
+    int intern(std::vector<int> states);
+    int step(int d, int symbol);
+    size_t longestAt(const char* data, size_t len, size_t at, bool bol);
+
+    void scanLiteral(const char* data, size_t len, const std::function<void(size_t, size_t)>& span);
+    void scanAhoCorasick(const char* data, size_t len, const std::function<void(size_t, size_t)>& span);
+    void scanRegex(const char* data, size_t len, const std::function<void(size_t, size_t)>& span);
+};
+
+#endif // MATCHER_HPP
@@ -1,13 +1,66 @@
 #include "Multiplex.hpp"
+#include "Terminal.hpp"
+#include "PaneSnapshot.hpp"
+#include "MappedFile.hpp"
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <string>
 #include <filesystem>
 
 namespace fs = std::filesystem;
 
+namespace {
+const std::chrono::milliseconds THROTTLED_FRAME_INTERVAL(50);
+
+// A workspace file: the header, the layout nodes in pre-order (a split,
+// then its childA subtree, then its childB subtree), a table of panes
+// (layout panes in node order, then background panes) and each pane's
+// PaneSnapshot. Like snapshots, it is read on the machine layout it was
+// written with.
+const char WORKSPACE_MAGIC[8] = { 'M', 'I', 'N', 'S', 'H', 'W', 'K', 'S' };
+const uint32_t WORKSPACE_VERSION = 1;
+const uint32_t WORKSPACE_BYTE_ORDER = 0x01020304;
+
+// More panes than this are taken for damage rather than built
+const uint32_t MAX_WORKSPACE_PANES = 1024;
+
+struct WorkspaceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t nodeCount;
+    uint32_t paneCount;       // Background ones included
+    uint32_t backgroundCount; // The last ones in the table
+    int32_t activePane;
+    int32_t nextPaneId;
+    uint32_t reserved;
+};
+
+struct WorkspaceNode {
+    uint32_t type;   // SplitType
+    float splitRatio;
+    int32_t pane;    // Table index for a leaf, -1 for a split
+};
+
+struct WorkspacePane {
+    int32_t id;
+    uint32_t reserved;
+    uint64_t offset; // From the start of the file
+    uint64_t length;
+};
+
+static_assert(sizeof(WorkspaceHeader) == 40 && sizeof(WorkspaceNode) == 12 && sizeof(WorkspacePane) == 24,
+              "workspace records must not be padded");
+
+template <class T>
+void append(std::string& out, const T& record) {
+    out.append(reinterpret_cast<const char*>(&record), sizeof(record));
+}
+}
+
 Multiplexer::Multiplexer() {
-    hOut = GetStdHandle(STD_OUTPUT_HANDLE);
     updateSize();
     
     root = std::make_unique<LayoutNode>();
@@ -39,14 +92,23 @@ void Multiplexer::exitGuiMode() {
 }
 
 void Multiplexer::updateSize() {
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    if (GetConsoleScreenBufferInfo(hOut, &csbi)) {
-        cols = csbi.srWindow.Right - csbi.srWindow.Left + 1;
-        rows = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
-    } else {
-        cols = 80;
-        rows = 24;
+    if (fixedCols > 0 && fixedRows > 0) {
+        cols = fixedCols;
+        rows = fixedRows;
+        return;
     }
+    Terminal::getSize(cols, rows);
+}
+
+void Multiplexer::setFixedSize(int c, int r) {
+    fixedCols = c;
+    fixedRows = r;
+    layoutDirty = true;
+}
+
+void Multiplexer::setRenderer(std::unique_ptr<Renderer> r) {
+    renderer = std::move(r);
+    layoutDirty = true;
 }
 
 Pane& Multiplexer::getActivePane() {
@@ -126,6 +188,7 @@ void Multiplexer::addPane() {
     
     debugLog("addPane: recalculateLayout");
     calculateLayout(root.get(), {0, 0, cols, rows});
+    layoutDirty = true;
     debugLog("addPane: Done");
 }
 
@@ -184,51 +247,69 @@ void Multiplexer::calculateLayout(LayoutNode* node, Rect r) {
     }
 }
 
-void Multiplexer::setCursor(int x, int y) {
-    COORD c; c.X = x; c.Y = y;
-    SetConsoleCursorPosition(hOut, c);
+void Multiplexer::invalidate() {
+    layoutDirty = true;
 }
 
 void Multiplexer::render() {
-    updateSize();
-    
-    calculateLayout(root.get(), {0, 0, cols, rows});
-    
-    renderBuffer.resize(cols * rows);
-    for (auto& c : renderBuffer) {
-        c.Char.UnicodeChar = ' ';
-        c.Attributes = 0x07;
+    if (!renderer) renderer = createRenderer();
+    retiredRoot.reset();
+    retiredPanes.clear();
+
+    bool full = layoutDirty;
+    if (full) {
+        updateSize();
+        calculateLayout(root.get(), {0, 0, cols, rows});
+        frame.reset(cols, rows);
+        layoutDirty = false;
     }
-    
-    renderNode(root.get());
-    
+
+    renderNode(root.get(), full);
+
+    int cx = lastCursorX, cy = lastCursorY;
     if (activeNode && activeNode->pane) {
         Rect r = activeNode->cachedRect;
         Pane* p = activeNode->pane.get();
-        int cx = r.x + p->cx;
-        int cy = r.y + p->cy;
+        cx = r.x + p->cx;
+        cy = r.y + p->cy;
         if (cx >= cols) cx = cols - 1;
         if (cy >= rows) cy = rows - 1;
-        setCursor(cx, cy);
     }
-    
-    COORD bufSize = { (SHORT)cols, (SHORT)rows };
-    COORD bufCoord = { 0, 0 };
-    SMALL_RECT writeRegion = { 0, 0, (SHORT)(cols - 1), (SHORT)(rows - 1) };
-    
-    WriteConsoleOutputW(hOut, renderBuffer.data(), bufSize, bufCoord, &writeRegion);
+
+    bool damaged = frame.hasDamage();
+    if (!damaged && cx == lastCursorX && cy == lastCursorY) return;
+
+    renderer->present(frame, cx, cy);
+    frame.clearDamage();
+    lastCursorX = cx;
+    lastCursorY = cy;
+    if (damaged) frameGeneration++;
 }
 
-void Multiplexer::renderNode(LayoutNode* node) {
+// Composes the damaged rows of each pane into the frame. With full set,
+// every row is redrawn along with the split dividers.
+void Multiplexer::renderNode(LayoutNode* node, bool full) {
     if (!node) return;
     
     if (node->type == SPLIT_NONE) {
         if (!node->pane) return;
         Pane* p = node->pane.get();
+        p->loadPendingSnapshot(); // Restored panes are read in once visible
+        Grid* g = p->grid.get();
+        // Taking the marker down needs the top row back, wherever the pane
+        // is scrolled to.
+        bool paneFull = full || (p->throttleMarker && !p->throttled);
+        if (!paneFull && !g->is_dirty()) return;
+
+        // A flooding pane is painted at most every THROTTLED_FRAME_INTERVAL;
+        // its rows stay dirty in between.
+        auto now = std::chrono::steady_clock::now();
+        if (!paneFull && p->throttled && now - p->lastPaint < THROTTLED_FRAME_INTERVAL) return;
+        p->lastPaint = now;
         Rect r = node->cachedRect;
         
-        int totalLines = p->grid->lines.size();
-        int gridH = p->grid->sy;
+        int totalLines = g->total_lines();
+        int gridH = g->sy;
         
         // Calculate startLine based on scrollOffset
         // scrollOffset = 0 means bottom.
@@ -240,81 +321,85 @@ void Multiplexer::renderNode(LayoutNode* node) {
              startLine = -p->scrollOffset; // Handle small content
         }
         if (startLine < 0) startLine = 0;
+        // Shown history rows have no dirty flags; once the grid scrolls
+        // they and the thumb all move
+        if (g->scrolled() && (p->scrollOffset > 0 || startLine < g->hsize)) paneFull = true;
         
+        // Scrollbar thumb, drawn over the last column of each redrawn row.
+        // It only moves when the grid scrolls, which redraws every row.
+        bool scrollbar = totalLines > r.h && r.x + r.w - 1 < cols;
+        int thumbPos = 0, thumbSize = 0;
+        if (scrollbar) {
+             float ratio = (float)r.h / totalLines;
+             if (ratio > 1.0f) ratio = 1.0f;
+             thumbSize = std::max(1, (int)(r.h * ratio));
+             
+             // Normal visual scrollbar: Top is index 0.
+             // Thumb Y / Track H = startLine / TotalLines
+             thumbPos = (int)((float)startLine / totalLines * r.h);
+             if (thumbPos < 0) thumbPos = 0;
+             if (thumbPos + thumbSize > r.h) thumbPos = r.h - thumbSize;
+        }
         
         for (int y = 0; y < gridH && y < r.h; ++y) {
             int absY = startLine + y;
-            if (absY < totalLines) {
-                 const GridLine& gl = *p->grid->lines[absY];
-                 for (int x = 0; x < (int)gl.cells.size() && x < r.w; ++x) {
-                     int dest = (r.y + y) * cols + (r.x + x);
-                     if (dest < (int)renderBuffer.size()) {
-                         renderBuffer[dest].Char.UnicodeChar = (WCHAR)gl.cells[x].data;
-                         renderBuffer[dest].Attributes = gl.cells[x].attr;
-                     }
-                 }
+            if (absY >= totalLines) continue;
+            // History rows only change when the grid scrolls.
+            if (!paneFull && (absY < g->hsize || !g->row_dirty(absY - g->hsize))) continue;
+            if (r.y + y >= rows) break;
+
+            const GridCell* cells = g->view_line(absY, lineBuffer);
+            int w = std::min(g->sx, std::min(r.w, cols - r.x));
+            FrameCell* dest = &frame.cells[(size_t)(r.y + y) * cols + r.x];
+            for (int x = 0; x < w; ++x) {
+                dest[x].ch = cells[x].data;
+                dest[x].attr = cells[x].attr;
             }
+            if (scrollbar) {
+                FrameCell& sb = dest[r.w - 1];
+                sb.ch = (y >= thumbPos && y < thumbPos + thumbSize) ? 0x2588 : 0x2502; // Thumb : Track
+                sb.attr = 0x08;
+            }
+            frame.markDamage(r.y + y, r.x, r.x + r.w - 1);
         }
-        
-        if (totalLines > r.h) {
-            int sbX = r.x + r.w - 1;
-            if (sbX < cols) {
-                 float ratio = (float)r.h / totalLines;
-                 if (ratio > 1.0f) ratio = 1.0f;
-                 int thumbSize = std::max(1, (int)(r.h * ratio));
-                 
-                 // Thumb position:
-                 // viewport top = startLine
-                 // range = 0 to totalLines - r.h
-                 // But visual scroll is inverted: 0 is top.
-                 // startLine 0 is top. startLine max is bottom.
-                 
-                 // wait, startLine increases as we scroll DOWN (to bottom).
-                 // if scrollOffset is 0, startLine is Max.
-                 
-                 // Normal visual scrollbar: Top is index 0.
-                 // Thumb Y / Track H = startLine / TotalLines
-                 
-                 int thumbPos = (int)((float)startLine / totalLines * r.h);
-                 if (thumbPos < 0) thumbPos = 0;
-                 if (thumbPos + thumbSize > r.h) thumbPos = r.h - thumbSize;
-
-                 for (int y = 0; y < r.h; ++y) {
-                      int dest = (r.y + y) * cols + sbX;
-                      if (dest < (int)renderBuffer.size()) {
-                          if (y >= thumbPos && y < thumbPos + thumbSize) {
-                              renderBuffer[dest].Char.UnicodeChar = 0x2588; 
-                              renderBuffer[dest].Attributes = 0x08;
-                          } else {
-                              renderBuffer[dest].Char.UnicodeChar = 0x2502; // Track
-                              renderBuffer[dest].Attributes = 0x08;
-                          }
-                      }
-                 }
+        g->clear_dirty();
+
+        if (p->throttled && r.y < rows) {
+            static const char marker[] = " output throttled ";
+            int len = (int)sizeof(marker) - 1;
+            int right = std::min(r.x + r.w - (scrollbar ? 1 : 0), cols);
+            int left = std::max(r.x, right - len);
+            FrameCell* dest = &frame.cells[(size_t)r.y * cols];
+            for (int x = left; x < right; ++x) {
+                dest[x].ch = marker[x - left];
+                dest[x].attr = 0x70;
             }
+            if (left < right) frame.markDamage(r.y, left, right - 1);
         }
+        p->throttleMarker = p->throttled;
         
     } else {
-        renderNode(node->childA.get());
-        renderNode(node->childB.get());
+        renderNode(node->childA.get(), full);
+        renderNode(node->childB.get(), full);
+        if (!full) return;
         
         Rect r = node->cachedRect;
         if (node->type == SPLIT_VERTICAL) {
              int divX = (int)(r.w * node->splitRatio) + r.x;
              for (int y = r.y; y < r.y + r.h; ++y) {
                  int dest = y * cols + divX;
-                 if (dest < (int)renderBuffer.size()) {
-                     renderBuffer[dest].Char.UnicodeChar = 0x2502; 
-                     renderBuffer[dest].Attributes = 0x08;
+                 if (dest < (int)frame.cells.size()) {
+                     frame.cells[dest].ch = 0x2502; 
+                     frame.cells[dest].attr = 0x08;
                  }
              }
         } else {
              int divY = (int)(r.h * node->splitRatio) + r.y;
              for (int x = r.x; x < r.x + r.w; ++x) {
                  int dest = divY * cols + x;
-                 if (dest < (int)renderBuffer.size()) {
-                     renderBuffer[dest].Char.UnicodeChar = 0x2500; 
-                     renderBuffer[dest].Attributes = 0x08;
+                 if (dest < (int)frame.cells.size()) {
+                     frame.cells[dest].ch = 0x2500; 
+                     frame.cells[dest].attr = 0x08;
                  }
              }
         }
@@ -344,7 +429,7 @@ void Multiplexer::handleMouse(int x, int y, int button) {
              // Scrollbar click
              // Map Y to scroll position
              Pane* p = node->pane.get();
-             int totalLines = p->grid->lines.size();
+             int totalLines = p->grid->total_lines();
              
              if (totalLines > r.h) {
                  float clickRatio = (float)(y - r.y) / r.h;
@@ -363,7 +448,7 @@ void Multiplexer::handleMouse(int x, int y, int button) {
                  int newOffset = totalLines - gridH - targetLine;
                   if (newOffset < 0) newOffset = 0;
                  
-                  p->scrollOffset = newOffset;
+                  p->scroll(newOffset - p->scrollOffset);
              }
          } else {
              // Handle wheel? Or just focus.
@@ -422,6 +507,7 @@ bool Multiplexer::detachActivePane() {
     // Save pane to background
     if (activeNode->pane) {
         activeNode->pane->detachTime = std::chrono::steady_clock::now();
+        activeNode->pane->setDetached(true);
         backgroundPanes.push_back(std::move(activeNode->pane));
     }
     
@@ -454,6 +540,7 @@ bool Multiplexer::detachActivePane() {
     
     updateSize(); // Refresh sizes
     calculateLayout(root.get(), {0, 0, cols, rows});
+    layoutDirty = true;
     
     if (activeNode && activeNode->pane) {
         activeNode->pane->write("Pane detached. Background count: " + std::to_string(backgroundPanes.size()) + "\n");
@@ -500,11 +587,15 @@ bool Multiplexer::retachPane(int index) {
     // Focus new pane
     activeNode = activeNode->childB.get();
     
+    // Sized first, so the log collected while detached is parsed at the
+    // width it will be shown at
+    calculateLayout(root.get(), {0, 0, cols, rows});
+    layoutDirty = true;
+    
     if (activeNode->pane) {
+         activeNode->pane->setDetached(false);
          activeNode->pane->write("Pane retached.\n");
     }
-    
-    calculateLayout(root.get(), {0, 0, cols, rows});
     debugLog("retach: Done");
     return true;
 }
@@ -521,3 +612,181 @@ std::vector<Pane*> Multiplexer::getAllPanes() {
     for(auto& p : backgroundPanes) panes.push_back(p.get());
     return panes;
 }
+
+void Multiplexer::saveWorkspace(std::string& out) {
+    std::vector<LayoutNode*> nodes;
+    std::vector<Pane*> panes;
+    auto traverse = [&](auto&& self, LayoutNode* n) -> void {
+        if (!n) return;
+        nodes.push_back(n);
+        if (n->type == SPLIT_NONE) {
+            if (n->pane) panes.push_back(n->pane.get());
+        } else {
+            self(self, n->childA.get());
+            self(self, n->childB.get());
+        }
+    };
+    traverse(traverse, root.get());
+    for (auto& p : backgroundPanes) panes.push_back(p.get());
+
+    std::vector<std::string> snapshots(panes.size());
+    for (size_t i = 0; i < panes.size(); ++i) PaneSnapshot::write(*panes[i], snapshots[i]);
+
+    WorkspaceHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, WORKSPACE_MAGIC, sizeof(WORKSPACE_MAGIC));
+    h.version = WORKSPACE_VERSION;
+    h.byteOrder = WORKSPACE_BYTE_ORDER;
+    h.nodeCount = (uint32_t)nodes.size();
+    h.paneCount = (uint32_t)panes.size();
+    h.backgroundCount = (uint32_t)backgroundPanes.size();
+    h.activePane = getActivePaneIndex();
+    h.nextPaneId = nextPaneId;
+    append(out, h);
+
+    size_t leaf = 0;
+    for (LayoutNode* n : nodes) {
+        WorkspaceNode record;
+        record.type = (uint32_t)n->type;
+        record.splitRatio = n->splitRatio;
+        record.pane = (n->type == SPLIT_NONE && n->pane) ? (int32_t)leaf++ : -1;
+        append(out, record);
+    }
+
+    uint64_t offset = out.size() + panes.size() * sizeof(WorkspacePane);
+    for (size_t i = 0; i < panes.size(); ++i) {
+        WorkspacePane record;
+        memset(&record, 0, sizeof(record));
+        record.id = panes[i]->id;
+        record.offset = offset;
+        record.length = snapshots[i].size();
+        append(out, record);
+        offset += snapshots[i].size();
+    }
+    for (const std::string& snapshot : snapshots) out += snapshot;
+}
+
+bool Multiplexer::loadWorkspace(std::shared_ptr<MappedFile> file, std::string& error) {
+    const char* data = file->data();
+    size_t len = file->size();
+    WorkspaceHeader h;
+    if (len < sizeof(h) || memcmp(data, WORKSPACE_MAGIC, sizeof(WORKSPACE_MAGIC)) != 0) {
+        error = "not a workspace";
+        return false;
+    }
+    memcpy(&h, data, sizeof(h));
+    if (h.version != WORKSPACE_VERSION) {
+        error = "workspace version " + std::to_string(h.version) + " is not supported";
+        return false;
+    }
+    if (h.byteOrder != WORKSPACE_BYTE_ORDER) {
+        error = "workspace was saved on a different kind of machine";
+        return false;
+    }
+    uint64_t tables = sizeof(h) + (uint64_t)h.nodeCount * sizeof(WorkspaceNode) + (uint64_t)h.paneCount * sizeof(WorkspacePane);
+    // A tree has one fewer split than leaves
+    if (h.paneCount > MAX_WORKSPACE_PANES || h.nodeCount == 0 || h.nodeCount >= 2 * h.paneCount ||
+        h.backgroundCount > h.paneCount || tables > len) {
+        error = "workspace is damaged";
+        return false;
+    }
+    const char* nodeTable = data + sizeof(h);
+    const char* paneTable = nodeTable + (size_t)h.nodeCount * sizeof(WorkspaceNode);
+
+    // The node table has to be one whole tree placing every layout pane
+    // once, checked before any pane is made. open counts subtrees still
+    // expected: each node fills one, and a split asks for two more.
+    uint32_t layoutPanes = h.paneCount - h.backgroundCount;
+    std::vector<char> placed(layoutPanes, 0);
+    uint32_t open = 1;
+    uint32_t leaves = 0;
+    for (uint32_t i = 0; i < h.nodeCount; ++i) {
+        WorkspaceNode record;
+        memcpy(&record, nodeTable + (size_t)i * sizeof(record), sizeof(record));
+        bool valid = open > 0;
+        open--;
+        if (record.type == SPLIT_NONE) {
+            uint32_t index = (uint32_t)record.pane;
+            valid = valid && index < layoutPanes && !placed[index];
+            if (valid) placed[index] = 1;
+            leaves++;
+        } else {
+            valid = valid && (record.type == SPLIT_VERTICAL || record.type == SPLIT_HORIZONTAL) &&
+                    record.splitRatio > 0.0f && record.splitRatio < 1.0f;
+            open += 2;
+        }
+        if (!valid) {
+            error = "workspace is damaged";
+            return false;
+        }
+    }
+    if (open != 0 || leaves != layoutPanes) {
+        error = "workspace is damaged";
+        return false;
+    }
+
+    updateSize();
+    int maxId = 0;
+    std::vector<std::unique_ptr<Pane>> panes(h.paneCount);
+    for (uint32_t i = 0; i < h.paneCount; ++i) {
+        WorkspacePane record;
+        memcpy(&record, paneTable + (size_t)i * sizeof(record), sizeof(record));
+        std::string cwd;
+        if (record.offset > len || record.length > len - record.offset ||
+            !PaneSnapshot::readCwd(data + record.offset, (size_t)record.length, cwd)) {
+            error = "workspace is damaged";
+            return false;
+        }
+        auto pane = std::make_unique<Pane>(cols, rows);
+        pane->id = record.id;
+        maxId = std::max(maxId, record.id);
+        pane->cwd = cwd;
+        std::error_code ec;
+        if (fs::is_directory(cwd, ec)) pane->session->setCwd(cwd);
+        pane->setPendingSnapshot(file, (size_t)record.offset, (size_t)record.length);
+        panes[i] = std::move(pane);
+    }
+
+    // Rebuilds the checked tree; its depth is bounded by the pane cap
+    uint32_t next = 0;
+    LayoutNode* active = nullptr;
+    auto build = [&](auto&& self, LayoutNode* parent) -> std::unique_ptr<LayoutNode> {
+        WorkspaceNode record;
+        memcpy(&record, nodeTable + (size_t)next++ * sizeof(record), sizeof(record));
+        auto node = std::make_unique<LayoutNode>();
+        node->parent = parent;
+        if (record.type == SPLIT_NONE) {
+            node->pane = std::move(panes[record.pane]);
+            if (record.pane == h.activePane) active = node.get();
+            return node;
+        }
+        node->type = (SplitType)record.type;
+        node->splitRatio = record.splitRatio;
+        node->childA = self(self, node.get());
+        node->childB = self(self, node.get());
+        return node;
+    };
+    std::unique_ptr<LayoutNode> newRoot = build(build, nullptr);
+    std::vector<std::unique_ptr<Pane>> background;
+    auto now = std::chrono::steady_clock::now();
+    for (uint32_t i = h.paneCount - h.backgroundCount; i < h.paneCount; ++i) {
+        panes[i]->setDetached(true);
+        panes[i]->detachTime = now;
+        background.push_back(std::move(panes[i]));
+    }
+
+    retiredRoot = std::move(root);
+    for (auto& p : backgroundPanes) retiredPanes.push_back(std::move(p));
+    root = std::move(newRoot);
+    backgroundPanes = std::move(background);
+    activeNode = active;
+    if (!activeNode) {
+        activeNode = root.get();
+        while (activeNode->type != SPLIT_NONE) activeNode = activeNode->childA.get();
+    }
+    nextPaneId = std::max(h.nextPaneId, maxId + 1);
+
+    calculateLayout(root.get(), {0, 0, cols, rows});
+    layoutDirty = true;
+    return true;
+}
@@ -2,9 +2,9 @@
 #define MULTIPLEX_HPP
 
 #include "Panes.hpp"
+#include "Renderer.hpp"
 #include <vector>
 #include <memory>
-#include <windows.h>
 
 struct Rect {
     int x, y, w, h;
@@ -44,6 +44,8 @@ public:
     int getActivePaneIndex() const; 
 
     void render();
+    void invalidate(); // Forces a full re-layout and redraw on the next render
+    uint64_t getFrameGeneration() const { return frameGeneration; }
     void logToActive(const std::string& text);
     
     void enterGuiMode();
@@ -51,23 +53,47 @@ public:
     
     int cols, rows;
     void updateSize();
+    // Headless use (benchmarks): a fixed screen size instead of the
+    // terminal's (0 follows the terminal again), and a renderer of our own.
+    void setFixedSize(int fixedCols, int fixedRows);
+    void setRenderer(std::unique_ptr<Renderer> r);
     
     void handleMouse(int x, int y, int button);
     void handleMouseWheel(int x, int y, int delta);
 
+    // The layout and every pane in it, background ones included, as one
+    // workspace image (format in Multiplex.cpp).
+    void saveWorkspace(std::string& out);
+    // Replaces the layout and all panes with a saved workspace. Each pane's
+    // contents stay in file until the pane is first shown. False with error
+    // set, and nothing changed, when file does not hold a workspace.
+    bool loadWorkspace(std::shared_ptr<MappedFile> file, std::string& error);
+
 private:
     std::unique_ptr<LayoutNode> root;
     LayoutNode* activeNode;
     int nextPaneId = 1;
     
     std::vector<std::unique_ptr<Pane>> backgroundPanes;
+
+    // What a workspace load replaced. The command that loaded it still
+    // runs in one of these panes, so they go at the next render.
+    std::unique_ptr<LayoutNode> retiredRoot;
+    std::vector<std::unique_ptr<Pane>> retiredPanes;
     
     void calculateLayout(LayoutNode* node, Rect r);
-    void renderNode(LayoutNode* node);
-    void setCursor(int x, int y);
+    void renderNode(LayoutNode* node, bool full);
+    
+    std::unique_ptr<Renderer> renderer;
+    Frame frame;
     
-    HANDLE hOut;
-    std::vector<CHAR_INFO> renderBuffer;
+    int fixedCols = 0;
+    int fixedRows = 0;
+    bool layoutDirty = true;
+    uint64_t frameGeneration = 0;
+    int lastCursorX = -1;
+    int lastCursorY = -1;
+    std::vector<GridCell> lineBuffer; // scratch row for expanding history lines
     
     void flattenPanes(LayoutNode* node, std::vector<Pane*>& out);
 };
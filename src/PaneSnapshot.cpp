@@ -0,0 +1,333 @@
+#include "PaneSnapshot.hpp"
+#include "Panes.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char MAGIC[8] = { 'M', 'I', 'N', 'S', 'H', 'P', 'N', 'E' };
+const uint32_t VERSION = 1;
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+const uint32_t HISTORY_COMPRESSED = 1;
+
+// Larger grids are taken for damage; sx * sy * sizeof(GridCell) cannot
+// overflow below this.
+const int32_t MAX_SIDE = 10000;
+
+// Fixed-width fields only, each on its own natural alignment, so the
+// struct has no padding and is copied to and from the file whole.
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;       // BYTE_ORDER_MARK as the writer saw it
+    uint32_t cellSize;        // sizeof(GridCell)
+    uint32_t flags;
+    int32_t sx, sy;
+    int32_t hlimit, hsize;
+    int64_t hbase;
+    int32_t cx, cy;
+    int32_t savedX, savedY;
+    uint16_t currentAttr, savedAttr;
+    int32_t inputCursor;
+    uint32_t cwdBytes;
+    uint32_t inputBytes;
+    uint64_t historyBytes;    // As stored
+    uint64_t historyRawBytes; // Once decompressed
+};
+static_assert(sizeof(Header) == 96, "snapshot header must not be padded");
+
+// History is a run of lines, oldest first: byte count, text length, then
+// the CompactLine bytes.
+const size_t LINE_HEADER = 8;
+
+void put32(std::string& out, uint32_t v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+// ---- LZ ----
+//
+// LZ4-style sequences: a token byte (literal count in the high nibble,
+// match length - MIN_MATCH in the low one, 15 meaning more follows in
+// 255-steps), the literals, a two-byte offset back into the output and any
+// extra length bytes. The last sequence is literals only. Terminal lines
+// repeat prompts, paths and attribute runs, so this does well on them.
+
+const size_t MIN_MATCH = 4;
+const size_t MAX_OFFSET = 0xFFFF;
+const int HASH_BITS = 14;
+
+uint32_t hash4(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void putLength(std::string& out, size_t n) {
+    while (n >= 255) {
+        out += (char)255;
+        n -= 255;
+    }
+    out += (char)n;
+}
+
+void putSequence(std::string& out, const unsigned char* literals, size_t count, size_t offset, size_t match) {
+    size_t extra = match ? match - MIN_MATCH : 0;
+    unsigned char token = (unsigned char)((std::min<size_t>(count, 15) << 4) | std::min<size_t>(extra, 15));
+    out += (char)token;
+    if (count >= 15) putLength(out, count - 15);
+    out.append(reinterpret_cast<const char*>(literals), count);
+    if (!match) return;
+    out += (char)(offset & 0xFF);
+    out += (char)(offset >> 8);
+    if (extra >= 15) putLength(out, extra - 15);
+}
+
+void compress(const std::string& in, std::string& out) {
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(in.data());
+    size_t n = in.size();
+    std::vector<uint32_t> table((size_t)1 << HASH_BITS, UINT32_MAX);
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + MIN_MATCH <= n) {
+        uint32_t h = hash4(src + i);
+        size_t candidate = table[h];
+        table[h] = (uint32_t)i;
+        if (candidate == UINT32_MAX || i - candidate > MAX_OFFSET || memcmp(src + candidate, src + i, MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+        size_t length = MIN_MATCH;
+        while (i + length < n && src[candidate + length] == src[i + length]) length++;
+        putSequence(out, src + anchor, i - anchor, i - candidate, length);
+        i += length;
+        anchor = i;
+    }
+    if (anchor < n) putSequence(out, src + anchor, n - anchor, 0, 0);
+}
+
+// False when the input is damaged rather than reading past either end
+bool decompress(const char* data, size_t len, std::string& out, size_t rawBytes) {
+    const unsigned char* ip = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char* end = ip + len;
+    out.resize(rawBytes);
+    char* op = &out[0];
+    size_t produced = 0;
+
+    auto getLength = [&](size_t& n) {
+        unsigned char b;
+        do {
+            if (ip == end) return false;
+            b = *ip++;
+            n += b;
+        } while (b == 255);
+        return true;
+    };
+
+    while (ip < end) {
+        unsigned char token = *ip++;
+        size_t count = token >> 4;
+        if (count == 15 && !getLength(count)) return false;
+        if (count > (size_t)(end - ip) || count > rawBytes - produced) return false;
+        memcpy(op + produced, ip, count);
+        ip += count;
+        produced += count;
+        if (ip == end) break;
+
+        if (end - ip < 2) return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t match = token & 15;
+        if (match == 15 && !getLength(match)) return false;
+        match += MIN_MATCH;
+        if (offset == 0 || offset > produced || match > rawBytes - produced) return false;
+        // May overlap itself (a run), so byte by byte
+        const char* from = op + produced - offset;
+        for (size_t k = 0; k < match; ++k) op[produced + k] = from[k];
+        produced += match;
+    }
+    return produced == rawBytes;
+}
+
+}
+
+bool PaneSnapshot::isSnapshot(const char* data, size_t len) {
+    return len >= sizeof(MAGIC) && memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool PaneSnapshot::readCwd(const char* data, size_t len, std::string& cwd) {
+    Header h;
+    if (!isSnapshot(data, len) || len < sizeof(h)) return false;
+    memcpy(&h, data, sizeof(h));
+    if (h.version != VERSION || h.cwdBytes > len - sizeof(h)) return false;
+    cwd.assign(data + sizeof(h), h.cwdBytes);
+    return true;
+}
+
+void PaneSnapshot::write(Pane& pane, std::string& out) {
+    pane.loadPendingSnapshot();
+    if (pane.isDetached()) {
+        // Parses what arrived while detached
+        pane.setDetached(false);
+        pane.setDetached(true);
+    }
+    pane.loadSkippedHistory();
+    const Grid& g = *pane.grid;
+
+    std::string history;
+    for (int y = 0; y < g.hsize; ++y) {
+        const CompactLine& line = g.history_slot(y);
+        put32(history, (uint32_t)line.bytes.size());
+        put32(history, line.textLen);
+        history += line.bytes;
+    }
+    std::string packed;
+    compress(history, packed);
+    bool compressed = packed.size() < history.size();
+
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.byteOrder = BYTE_ORDER_MARK;
+    h.cellSize = sizeof(GridCell);
+    h.flags = compressed ? HISTORY_COMPRESSED : 0;
+    h.sx = g.sx;
+    h.sy = g.sy;
+    h.hlimit = g.hlimit;
+    h.hsize = g.hsize;
+    h.hbase = g.hbase;
+    h.cx = pane.cx;
+    h.cy = pane.cy;
+    h.savedX = pane.savedX;
+    h.savedY = pane.savedY;
+    h.currentAttr = pane.currentAttr;
+    h.savedAttr = pane.savedAttr;
+    h.inputCursor = pane.inputCursor;
+    h.cwdBytes = (uint32_t)pane.cwd.size();
+    h.inputBytes = (uint32_t)pane.currentInput.size();
+    h.historyBytes = compressed ? packed.size() : history.size();
+    h.historyRawBytes = history.size();
+
+    size_t screenBytes = (size_t)g.sx * g.sy * sizeof(GridCell);
+    out.reserve(out.size() + sizeof(h) + h.cwdBytes + h.inputBytes + screenBytes + h.historyBytes);
+    out.append(reinterpret_cast<const char*>(&h), sizeof(h));
+    out += pane.cwd;
+    out += pane.currentInput;
+    // Screen rows top to bottom; the slab is a ring, so at most two pieces
+    size_t rowBytes = (size_t)g.sx * sizeof(GridCell);
+    size_t top = (size_t)g.first * rowBytes;
+    const char* slab = reinterpret_cast<const char*>(g.cells.data());
+    out.append(slab + top, screenBytes - top);
+    out.append(slab, top);
+    out += compressed ? packed : history;
+}
+
+bool PaneSnapshot::read(Pane& pane, const char* data, size_t len, std::string& error) {
+    Header h;
+    if (!isSnapshot(data, len) || len < sizeof(h)) {
+        error = "not a session snapshot";
+        return false;
+    }
+    memcpy(&h, data, sizeof(h));
+    if (h.version != VERSION) {
+        error = "snapshot version " + std::to_string(h.version) + " is not supported";
+        return false;
+    }
+    if (h.byteOrder != BYTE_ORDER_MARK || h.cellSize != sizeof(GridCell)) {
+        error = "snapshot was saved on a different kind of machine";
+        return false;
+    }
+    if (h.sx <= 0 || h.sy <= 0 || h.sx > MAX_SIDE || h.sy > MAX_SIDE ||
+        h.hlimit < 0 || h.hsize < 0 || h.hsize > h.hlimit) {
+        error = "snapshot is damaged";
+        return false;
+    }
+
+    size_t screenBytes = (size_t)h.sx * h.sy * sizeof(GridCell);
+    uint64_t need = sizeof(h) + (uint64_t)h.cwdBytes + h.inputBytes + screenBytes + h.historyBytes;
+    if (need > len) {
+        error = "snapshot is truncated";
+        return false;
+    }
+    const char* p = data + sizeof(h);
+    std::string cwd(p, h.cwdBytes);
+    p += h.cwdBytes;
+    std::string input(p, h.inputBytes);
+    p += h.inputBytes;
+    const char* screen = p;
+    p += screenBytes;
+
+    std::string unpacked;
+    const char* history = p;
+    size_t historyBytes = (size_t)h.historyBytes;
+    if (h.flags & HISTORY_COMPRESSED) {
+        // A sequence cannot stand for more than a few hundred bytes per
+        // byte, so a bigger claim is damage, not a reason to allocate
+        if (h.historyRawBytes / 256 > h.historyBytes ||
+            !decompress(p, historyBytes, unpacked, (size_t)h.historyRawBytes)) {
+            error = "snapshot is damaged";
+            return false;
+        }
+        history = unpacked.data();
+        historyBytes = unpacked.size();
+    }
+    // Every line has its header, so this bounds what hsize may claim
+    // before it sizes anything
+    if ((size_t)h.hsize > historyBytes / LINE_HEADER) {
+        error = "snapshot is damaged";
+        return false;
+    }
+
+    auto grid = std::make_unique<Grid>(h.sx, h.sy, h.hlimit);
+    memcpy(grid->cells.data(), screen, screenBytes);
+    grid->history.resize(h.hsize);
+    size_t at = 0;
+    for (int y = 0; y < h.hsize; ++y) {
+        uint32_t bytes, textLen;
+        if (historyBytes - at < LINE_HEADER) {
+            error = "snapshot is damaged";
+            return false;
+        }
+        memcpy(&bytes, history + at, 4);
+        memcpy(&textLen, history + at + 4, 4);
+        at += LINE_HEADER;
+        if (bytes > historyBytes - at || textLen > bytes) {
+            error = "snapshot is damaged";
+            return false;
+        }
+        grid->history[y].bytes.assign(history + at, bytes);
+        grid->history[y].textLen = textLen;
+        at += bytes;
+    }
+    grid->hsize = h.hsize;
+    grid->hbase = h.hbase;
+
+    int width = pane.grid->sx;
+    int height = pane.grid->sy;
+    pane.grid = std::move(grid);
+    pane.cx = std::min(std::max(h.cx, 0), h.sx);
+    pane.cy = std::min(std::max(h.cy, 0), h.sy - 1);
+    pane.savedX = std::min(std::max(h.savedX, 0), h.sx);
+    pane.savedY = std::min(std::max(h.savedY, 0), h.sy - 1);
+    pane.currentAttr = h.currentAttr;
+    pane.savedAttr = h.savedAttr;
+    pane.scrollOffset = 0;
+    pane.hasSelection = false;
+    pane.parser.reset();
+    pane.utf8Left = 0;
+    pane.skippedLog.clear();
+    pane.currentInput = input;
+    pane.inputCursor = std::min(std::max(h.inputCursor, 0), (int)input.size());
+    pane.resize(width, height);
+
+    pane.cwd = cwd;
+    std::error_code ec;
+    if (pane.session && fs::is_directory(cwd, ec)) pane.session->setCwd(cwd);
+    return true;
+}
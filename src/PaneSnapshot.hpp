@@ -0,0 +1,33 @@
+#ifndef PANE_SNAPSHOT_HPP
+#define PANE_SNAPSHOT_HPP
+
+#include <string>
+#include <cstddef>
+
+class Pane;
+
+// Versioned binary image of a pane: grid size, the screen cells with their
+// attributes, scrollback, cursor, cwd and input line. The screen is stored
+// as the grid holds it in memory and history as its compact lines, so
+// reading one back is a few bulk copies; history is LZ compressed when that
+// makes it smaller. Files are read on the machine layout they were written
+// with (byte order and cell size are checked, not converted).
+class PaneSnapshot {
+public:
+    // Appends pane's snapshot to out. Skipped history and output held
+    // while detached are parsed first, so everything is in it.
+    static void write(Pane& pane, std::string& out);
+
+    // Replaces pane's contents with the snapshot in [data, data + len).
+    // The pane keeps its size; a snapshot taken at another size is resized
+    // to it. Output held while detached stays queued after it. False with
+    // error set when this is not a snapshot this version reads, leaving the
+    // pane alone.
+    static bool read(Pane& pane, const char* data, size_t len, std::string& error);
+
+    static bool isSnapshot(const char* data, size_t len);
+    // The directory a snapshot was taken in, without reading the rest
+    static bool readCwd(const char* data, size_t len, std::string& cwd);
+};
+
+#endif // PANE_SNAPSHOT_HPP
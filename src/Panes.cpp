@@ -1,33 +1,232 @@
 #include "Panes.hpp"
+#include "PaneSnapshot.hpp"
+#include "MappedFile.hpp"
 #include <filesystem>
+#include <algorithm>
+#include <cstring>
 
 namespace fs = std::filesystem;
 
-Grid::Grid(int sx, int sy) : sx(sx), sy(sy), hsize(0) {
-    for (int i = 0; i < sy; ++i) {
-        lines.push_back(std::make_unique<GridLine>(sx));
+namespace {
+
+void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += (char)cp;
+    } else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+uint32_t next_utf8(const unsigned char* s, size_t len, size_t& pos) {
+    if (pos >= len) return ' ';
+    uint32_t cp = s[pos++];
+    int extra = 0;
+    if (cp >= 0xF0) { cp &= 0x07; extra = 3; }
+    else if (cp >= 0xE0) { cp &= 0x0F; extra = 2; }
+    else if (cp >= 0xC0) { cp &= 0x1F; extra = 1; }
+    while (extra-- > 0 && pos < len) {
+        cp = (cp << 6) | (s[pos++] & 0x3F);
     }
+    return cp;
+}
+
+bool is_blank(const GridCell& c) {
+    return c.data == ' ' && c.attr == 0x07 && c.flags == 0;
 }
 
+const size_t RUN_SIZE = 5; // attr (2), flags (1), cell count (2)
+
+// Bytes put_char() stores as a single cell: ASCII from space up, DEL included.
+bool is_plain(char c) {
+    return (unsigned char)c >= 0x20 && (unsigned char)c < 0x80;
+}
+
+// First byte in [p, end) that is not plain, eight bytes at a time: a word
+// holds only plain bytes when subtracting 0x20 from each byte borrows
+// nowhere and no byte has its top bit set.
+const char* find_special(const char* p, const char* end) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    while (end - p >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        if (((v - ones * 0x20) | v) & highs) break;
+        p += 8;
+    }
+    while (p < end && is_plain(*p)) p++;
+    return p;
+}
+
+}
+
+Grid::Grid(int sx, int sy, int hlimit)
+    : sx(sx), sy(sy), hsize(0), hlimit(hlimit), cells((size_t)sx * sy),
+      first(0), rowDirty(sy, 1), damaged(true), hfirst(0) {}
+
 Grid::~Grid() {}
 
-void Grid::resize(int new_sx, int new_sy) {
-    if (new_sx != sx) {
-        for (auto& line : lines) {
-            line->cells.resize(new_sx);
+void Grid::mark_all_dirty() {
+    std::fill(rowDirty.begin(), rowDirty.end(), 1);
+    damaged = true;
+}
+
+void Grid::clear_dirty() {
+    historyMoved = false;
+    if (!damaged) return;
+    std::fill(rowDirty.begin(), rowDirty.end(), 0);
+    damaged = false;
+}
+
+GridCell* Grid::screen_line(int y) {
+    return &cells[(size_t)((first + y) % sy) * sx];
+}
+
+const GridCell* Grid::screen_line(int y) const {
+    return &cells[(size_t)((first + y) % sy) * sx];
+}
+
+// Returns line y of the grid. History lines are expanded into scratch.
+const GridCell* Grid::view_line(int y, std::vector<GridCell>& scratch) const {
+    if (y >= hsize) return screen_line(y - hsize);
+    scratch.resize(sx);
+    expand(history_slot(y), scratch.data(), sx);
+    return scratch.data();
+}
+
+void Grid::clear_screen_line(int y) {
+    GridCell* row = screen_line(y);
+    std::fill(row, row + sx, GridCell());
+}
+
+void Grid::freeze(const GridCell* row, CompactLine& out) {
+    int len = sx;
+    while (len > 0 && is_blank(row[len - 1])) len--;
+
+    out.bytes.clear();
+    for (int x = 0; x < len; ++x) append_utf8(out.bytes, row[x].data);
+    out.textLen = (uint32_t)out.bytes.size();
+
+    int x = 0;
+    while (x < len) {
+        int start = x;
+        uint16_t attr = row[x].attr;
+        uint8_t flags = row[x].flags;
+        while (x < len && x - start < 0xFFFF && row[x].attr == attr && row[x].flags == flags) x++;
+        int n = x - start;
+        out.bytes += (char)(attr & 0xFF);
+        out.bytes += (char)(attr >> 8);
+        out.bytes += (char)flags;
+        out.bytes += (char)(n & 0xFF);
+        out.bytes += (char)(n >> 8);
+    }
+}
+
+void Grid::expand(const CompactLine& line, GridCell* row, int width) const {
+    const unsigned char* b = (const unsigned char*)line.bytes.data();
+    size_t pos = 0;
+    int x = 0;
+    for (size_t r = line.textLen; r + RUN_SIZE <= line.bytes.size() && x < width; r += RUN_SIZE) {
+        uint16_t attr = (uint16_t)(b[r] | (b[r + 1] << 8));
+        uint8_t flags = b[r + 2];
+        int n = b[r + 3] | (b[r + 4] << 8);
+        for (int i = 0; i < n && x < width; ++i, ++x) {
+            row[x].data = next_utf8(b, line.textLen, pos);
+            row[x].attr = attr;
+            row[x].flags = flags;
         }
-        sx = new_sx;
     }
-    sy = new_sy;
-    while (lines.size() < (size_t)sy) {
-        lines.push_back(std::make_unique<GridLine>(sx));
+    for (; x < width; ++x) row[x] = GridCell();
+}
+
+void Grid::push_history(const GridCell* row) {
+    if (hlimit == 0) return;
+    if (hsize == hlimit) {
+        // Full: the oldest slot takes the new line.
+        freeze(row, history[hfirst]);
+        hfirst = (hfirst + 1) % history.size();
+        hbase++;
+        return;
+    }
+    // Below the limit the ring has not wrapped, so new slots go at the end.
+    if (hsize == (int)history.size()) history.emplace_back();
+    hsize++;
+    freeze(row, history_slot(hsize - 1));
+}
+
+void Grid::pop_history(GridCell* row, int width) {
+    expand(history_slot(hsize - 1), row, width);
+    hsize--;
+}
+
+int Grid::resize(int new_sx, int new_sy, int cursor_y) {
+    if (new_sx == sx && new_sy == sy) return cursor_y;
+
+    std::vector<GridCell> fresh((size_t)new_sx * new_sy);
+    int w = std::min(sx, new_sx);
+    int from = 0; // first old screen row kept
+    int to = 0;   // slab row it lands on
+
+    if (new_sy < sy) {
+        // Drop rows below the cursor first, then push the top into history.
+        int drop = std::min(sy - new_sy, std::max(0, sy - 1 - cursor_y));
+        int push = sy - new_sy - drop;
+        for (int y = 0; y < push; ++y) push_history(screen_line(y));
+        from = push;
+        cursor_y -= push;
+    } else if (new_sy > sy) {
+        // Pull history back onto the screen before adding blank rows.
+        int pull = std::min(new_sy - sy, hsize);
+        for (int y = pull - 1; y >= 0; --y) pop_history(&fresh[(size_t)y * new_sx], new_sx);
+        to = pull;
+        cursor_y += pull;
+    }
+
+    for (int y = from; y < sy && to < new_sy; ++y, ++to) {
+        const GridCell* src = screen_line(y);
+        std::copy(src, src + w, &fresh[(size_t)to * new_sx]);
     }
+
+    cells.swap(fresh);
+    first = 0;
+    sx = new_sx;
+    sy = new_sy;
+    rowDirty.assign(sy, 1);
+    damaged = true;
+
+    if (cursor_y >= sy) cursor_y = sy - 1;
+    if (cursor_y < 0) cursor_y = 0;
+    return cursor_y;
+}
+
+void Grid::set_history_limit(int new_hlimit) {
+    if (new_hlimit < 0) new_hlimit = 0;
+    if (new_hlimit == hlimit) return;
+
+    int trim = std::max(0, hsize - new_hlimit);
+    std::vector<CompactLine> kept;
+    kept.reserve(hsize - trim);
+    for (int y = trim; y < hsize; ++y) kept.push_back(std::move(history_slot(y)));
+    history.swap(kept);
+    hfirst = 0;
+    hsize -= trim;
+    hbase += trim;
+    hlimit = new_hlimit;
 }
 
 const GridCell& Grid::get_cell(int x, int y) const {
-    if (y >= 0 && y < (int)lines.size()) {
-        if (x >= 0 && x < (int)lines[y]->cells.size()) {
-            return lines[y]->cells[x];
+    if (y >= 0 && y < sy) {
+        if (x >= 0 && x < sx) {
+            return screen_line(y)[x];
         }
     }
     static GridCell empty;
@@ -35,23 +234,99 @@ const GridCell& Grid::get_cell(int x, int y) const {
 }
 
 void Grid::write_cell(int x, int y, const GridCell& cell) {
-    if (y >= 0 && y < (int)lines.size()) {
+    if (y >= 0 && y < sy) {
          if (x >= 0 && x < sx) {
-             lines[y]->cells[x] = cell;
+             screen_line(y)[x] = cell;
+             mark_dirty(y);
          }
     }
 }
 
-void Grid::scroll_up() {
-    lines.push_back(std::make_unique<GridLine>(sx));
-    hsize++;
-    if (lines.size() > 2000) {
-        lines.erase(lines.begin());
-        hsize--;
+void Grid::write_run(int x, int y, const char* text, int n, uint16_t attr) {
+    if (y < 0 || y >= sy || x < 0 || x >= sx) return;
+    if (n > sx - x) n = sx - x;
+    if (n <= 0) return;
+
+    GridCell* row = screen_line(y) + x;
+    for (int i = 0; i < n; ++i) {
+        row[i].data = (unsigned char)text[i];
+        row[i].attr = attr;
+        row[i].flags = 0;
+    }
+    mark_dirty(y);
+}
+
+void Grid::flush_screen(int rows) {
+    for (int y = 0; y < rows && y < sy; ++y) scroll_up();
+    for (int y = 0; y < sy; ++y) clear_screen_line(y);
+    historyMoved = true;
+    mark_all_dirty();
+}
+
+void Grid::insert_history(int at, const Grid& src, int lines) {
+    if (hlimit == 0 || lines <= 0 || src.sx != sx) return;
+    at = std::max(0, std::min(at, hsize));
+    lines = std::min(lines, src.total_lines());
+
+    // Rare (once per attach at most), so the ring is simply rebuilt in order.
+    std::vector<CompactLine> merged;
+    merged.reserve(hsize + lines);
+    for (int y = 0; y < at; ++y) merged.push_back(std::move(history_slot(y)));
+    std::vector<GridCell> scratch;
+    for (int y = 0; y < lines; ++y) {
+        merged.emplace_back();
+        freeze(src.view_line(y, scratch), merged.back());
     }
+    for (int y = at; y < hsize; ++y) merged.push_back(std::move(history_slot(y)));
+
+    int trim = std::max(0, (int)merged.size() - hlimit);
+    merged.erase(merged.begin(), merged.begin() + trim);
+    history.swap(merged);
+    hfirst = 0;
+    hsize = (int)history.size();
+    hbase += trim;
+    historyMoved = true;
+    mark_all_dirty();
+}
+
+void Grid::clear_cells(int y, int x0, int x1, uint16_t attr) {
+    if (y < 0 || y >= sy) return;
+    x0 = std::max(x0, 0);
+    x1 = std::min(x1, sx);
+    if (x0 >= x1) return;
+
+    GridCell blank;
+    blank.attr = attr;
+    GridCell* row = screen_line(y);
+    std::fill(row + x0, row + x1, blank);
+    mark_dirty(y);
+}
+
+void Grid::insert_cells(int y, int x, int n, uint16_t attr) {
+    if (y < 0 || y >= sy || x < 0 || x >= sx) return;
+    n = std::min(n, sx - x);
+    GridCell* row = screen_line(y);
+    std::move_backward(row + x, row + sx - n, row + sx);
+    clear_cells(y, x, x + n, attr);
+}
+
+void Grid::delete_cells(int y, int x, int n, uint16_t attr) {
+    if (y < 0 || y >= sy || x < 0 || x >= sx) return;
+    n = std::min(n, sx - x);
+    GridCell* row = screen_line(y);
+    std::move(row + x + n, row + sx, row + x);
+    clear_cells(y, sx - n, sx, attr);
 }
 
-Pane::Pane(int w, int h) : cx(0), cy(0), scrollOffset(0), currentAttr(0x07), state(NORMAL) {
+void Grid::scroll_up() {
+    push_history(screen_line(0));
+    first = (first + 1) % sy;
+    clear_screen_line(sy - 1);
+    historyMoved = true;
+    mark_all_dirty();
+}
+
+Pane::Pane(int w, int h) : cx(0), cy(0), scrollOffset(0), currentAttr(0x07) {
     grid = std::make_unique<Grid>(w, h);
     session = std::make_unique<ShellSession>();
     
@@ -62,19 +337,21 @@ Pane::Pane(int w, int h) : cx(0), cy(0), scrollOffset(0), currentAttr(0x07), sta
     else cwd = ".";
     
     session->setCwd(cwd);
+    session->setWindowSize(w, h);
 }
 
 Pane::~Pane() {}
 
 void Pane::resize(int w, int h) {
     if (w <= 0 || h <= 0) return;
-    grid->resize(w, h);
+    if (w == grid->sx && h == grid->sy) return;
+    cy = grid->resize(w, h, cy);
     if (cx >= w) cx = w - 1;
-    if (cy >= h) cy = h - 1;
+    if (session) session->setWindowSize(w, h); // Keeps full-screen children in step
 }
 
 void Pane::repaint() {
-    grid = std::make_unique<Grid>(grid->sx, grid->sy);
+    grid = std::make_unique<Grid>(grid->sx, grid->sy, grid->hlimit);
     cx = 0;
     cy = 0;
     
@@ -97,114 +374,287 @@ void Pane::repaint() {
 }
 
 void Pane::write(const std::string& text) {
-    for (char c : text) {
-        put_char(c);
+    if (detached) {
+        append_raw(text);
+        return;
+    }
+    loadPendingSnapshot();
+
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        if (!parser.inGround() || utf8Left || !is_plain(*p)) {
+            put_char(*p++);
+            continue;
+        }
+        const char* run = p;
+        p = find_special(p, end);
+        write_run(run, p - run);
     }
 }
 
-void Pane::put_char(char c) {
-    if (state != NORMAL) {
-        handleAnsi(c);
-        return;
+// Same result as put_char() for each byte of a plain run, a row at a time.
+void Pane::write_run(const char* text, size_t len) {
+    while (len > 0) {
+        if (cx >= grid->sx) {
+            new_line();
+            cx = 0;
+        }
+        size_t room = grid->sx - cx;
+        int n = (int)std::min(len, room);
+        grid->write_run(cx, cy, text, n, currentAttr);
+        cx += n;
+        text += n;
+        len -= n;
     }
+}
+
+void Pane::put_char(char c) {
+    parser.advance(*this, (unsigned char)c);
+}
 
-    if (c == '\033') {
-        state = ESC;
-    } else if (c == '\n') {
+void Pane::put_glyph(uint32_t ch) {
+    if (cx >= grid->sx) {
         new_line();
         cx = 0;
-    } else if (c == '\r') {
-        cx = 0;
-    } else if (c == '\b') {
-        backspace();
-    } else if (c >= 32) {
-        GridCell cell;
-        cell.data = c;
-        cell.attr = currentAttr; 
-        
-        if (cx >= grid->sx) {
+    }
+
+    GridCell cell;
+    cell.data = ch;
+    cell.attr = currentAttr;
+    grid->write_cell(cx, cy, cell);
+    cx++;
+}
+
+// ---- VT parser events ----
+
+void Pane::vtPrint(unsigned char c) {
+    if (c < 0x80) {
+        utf8Left = 0;
+        put_glyph(c);
+        return;
+    }
+
+    // UTF-8 is assembled here; a broken sequence shows as U+FFFD.
+    if (c >= 0xC2 && c <= 0xF4) {
+        if (utf8Left) put_glyph(0xFFFD);
+        utf8Left = (c >= 0xF0) ? 3 : (c >= 0xE0) ? 2 : 1;
+        utf8Code = c & (0x3F >> utf8Left);
+    } else if (c < 0xC0 && utf8Left) {
+        utf8Code = (utf8Code << 6) | (c & 0x3F);
+        if (--utf8Left == 0) put_glyph(utf8Code);
+    } else {
+        utf8Left = 0;
+        put_glyph(0xFFFD);
+    }
+}
+
+void Pane::vtExecute(unsigned char c) {
+    switch (c) {
+        case '\n':
+        case '\v':
+        case '\f':
+            new_line();
+            cx = 0;
+            break;
+        case '\r':
+            cx = 0;
+            break;
+        case '\b':
+            if (cx >= grid->sx) cx = grid->sx - 1;
+            if (cx > 0) cx--;
+            break;
+        case '\t':
+            cx = std::min((cx / 8 + 1) * 8, grid->sx - 1);
+            break;
+        default:
+            break; // BEL and the rest
+    }
+}
+
+void Pane::vtEscDispatch(const VtParser& p, unsigned char final) {
+    if (p.intermediateCount() != 0) return; // Charset designations
+    switch (final) {
+        case '7':
+            savedX = cx;
+            savedY = cy;
+            savedAttr = currentAttr;
+            break;
+        case '8':
+            cx = std::min(savedX, grid->sx - 1);
+            cy = std::min(savedY, grid->sy - 1);
+            currentAttr = savedAttr;
+            break;
+        case 'D': // IND
             new_line();
+            break;
+        case 'E': // NEL
+            new_line();
+            cx = 0;
+            break;
+        case 'c': // RIS
+            currentAttr = 0x07;
             cx = 0;
+            cy = 0;
+            for (int y = 0; y < grid->sy; ++y) grid->clear_cells(y, 0, grid->sx, 0x07);
+            break;
+    }
+}
+
+void Pane::vtCsiDispatch(const VtParser& p, unsigned char final) {
+    // Private (?...) and intermediate forms are modes we do not emulate.
+    if (p.intermediateCount() != 0) return;
+
+    int n = p.param(0, 1);
+    int col = std::min(cx, grid->sx - 1);
+    uint16_t blank = erase_attr();
+
+    switch (final) {
+        case 'm':
+            select_graphic_rendition(p);
+            break;
+        case 'A': cy = std::max(cy - n, 0); break;
+        case 'B': cy = std::min(cy + n, grid->sy - 1); break;
+        case 'C': cx = std::min(col + n, grid->sx - 1); break;
+        case 'D': cx = std::max(col - n, 0); break;
+        case 'E': cy = std::min(cy + n, grid->sy - 1); cx = 0; break;
+        case 'F': cy = std::max(cy - n, 0); cx = 0; break;
+        case 'G':
+        case '`':
+            cx = std::min(n, grid->sx) - 1;
+            break;
+        case 'd':
+            cy = std::min(n, grid->sy) - 1;
+            break;
+        case 'H':
+        case 'f':
+            cy = std::min(n, grid->sy) - 1;
+            cx = std::min(p.param(1, 1), grid->sx) - 1;
+            break;
+        case 'J': {
+            int mode = p.param(0, 0);
+            if (mode == 0) {
+                grid->clear_cells(cy, col, grid->sx, blank);
+                for (int y = cy + 1; y < grid->sy; ++y) grid->clear_cells(y, 0, grid->sx, blank);
+            } else if (mode == 1) {
+                for (int y = 0; y < cy; ++y) grid->clear_cells(y, 0, grid->sx, blank);
+                grid->clear_cells(cy, 0, col + 1, blank);
+            } else if (mode == 2 || mode == 3) {
+                for (int y = 0; y < grid->sy; ++y) grid->clear_cells(y, 0, grid->sx, blank);
+            }
+            break;
         }
-        
-        int abs_y = 0;
-        if (grid->lines.size() < (size_t)grid->sy) {
-            abs_y = cy; 
-        } else {
-            int start_y = grid->lines.size() - grid->sy;
-            abs_y = start_y + cy;
+        case 'K': {
+            int mode = p.param(0, 0);
+            if (mode == 0) grid->clear_cells(cy, col, grid->sx, blank);
+            else if (mode == 1) grid->clear_cells(cy, 0, col + 1, blank);
+            else if (mode == 2) grid->clear_cells(cy, 0, grid->sx, blank);
+            break;
         }
-        
-        grid->write_cell(cx, abs_y, cell);
-        cx++;
+        case 'X':
+            grid->clear_cells(cy, col, col + n, blank);
+            break;
+        case '@':
+            grid->insert_cells(cy, col, n, blank);
+            break;
+        case 'P':
+            grid->delete_cells(cy, col, n, blank);
+            break;
+        case 's':
+            savedX = cx;
+            savedY = cy;
+            break;
+        case 'u':
+            cx = std::min(savedX, grid->sx - 1);
+            cy = std::min(savedY, grid->sy - 1);
+            break;
     }
 }
 
-void Pane::handleAnsi(char c) {
-    if (state == ESC) {
-        if (c == '[') {
-            state = CSI;
-            paramBuffer.clear();
-        } else {
-            state = NORMAL; 
-        }
-    } else if (state == CSI) {
-        if (isdigit(c) || c == ';') {
-            paramBuffer += c;
-        } else if (c == 'm') {
-            // SGR
-            if (paramBuffer.empty()) {
-                currentAttr = 0x07; 
+namespace {
+
+// SGR colour numbers are RGB bit order, console attributes are BGR.
+const uint16_t ANSI_TO_CONSOLE[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+const uint16_t FG_MASK = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
+const uint16_t BG_MASK = BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE | BACKGROUND_INTENSITY;
+const uint16_t ATTR_UNDERLINE = 0x8000; // COMMON_LVB_UNDERSCORE
+const uint16_t ATTR_REVERSE = 0x4000;   // COMMON_LVB_REVERSE_VIDEO
+
+// Nearest of the 16 console colours to an RGB value.
+uint16_t nearest_console_color(int r, int g, int b) {
+    int hi = std::max(r, std::max(g, b));
+    if (hi < 48) return 0;
+    uint16_t color = 0;
+    if (r * 2 > hi) color |= FOREGROUND_RED;
+    if (g * 2 > hi) color |= FOREGROUND_GREEN;
+    if (b * 2 > hi) color |= FOREGROUND_BLUE;
+    if (hi > 200) color |= FOREGROUND_INTENSITY;
+    return color;
+}
+
+uint16_t xterm_256_color(int n) {
+    if (n < 8) return ANSI_TO_CONSOLE[n];
+    if (n < 16) return ANSI_TO_CONSOLE[n - 8] | FOREGROUND_INTENSITY;
+    if (n < 232) {
+        static const int levels[6] = { 0, 95, 135, 175, 215, 255 };
+        n -= 16;
+        return nearest_console_color(levels[n / 36], levels[(n / 6) % 6], levels[n % 6]);
+    }
+    int gray = 8 + (n - 232) * 10;
+    return nearest_console_color(gray, gray, gray);
+}
+
+}
+
+uint16_t Pane::erase_attr() const {
+    return (currentAttr & BG_MASK) | 0x07;
+}
+
+void Pane::select_graphic_rendition(const VtParser& p) {
+    int count = std::max(p.paramCount(), 1);
+    for (int i = 0; i < count; ++i) {
+        int code = p.param(i, 0);
+        if (code == 0) {
+            currentAttr = 0x07;
+        } else if (code == 1) {
+            currentAttr |= FOREGROUND_INTENSITY;
+        } else if (code == 22) {
+            currentAttr &= ~FOREGROUND_INTENSITY;
+        } else if (code == 4) {
+            currentAttr |= ATTR_UNDERLINE;
+        } else if (code == 24) {
+            currentAttr &= ~ATTR_UNDERLINE;
+        } else if (code == 7) {
+            currentAttr |= ATTR_REVERSE;
+        } else if (code == 27) {
+            currentAttr &= ~ATTR_REVERSE;
+        } else if (code >= 30 && code <= 37) {
+            currentAttr = (currentAttr & ~(FG_MASK & ~FOREGROUND_INTENSITY)) | ANSI_TO_CONSOLE[code - 30];
+        } else if (code == 39) {
+            currentAttr = (currentAttr & ~(FG_MASK & ~FOREGROUND_INTENSITY)) | 0x07;
+        } else if (code >= 40 && code <= 47) {
+            currentAttr = (currentAttr & ~(BG_MASK & ~BACKGROUND_INTENSITY)) | (ANSI_TO_CONSOLE[code - 40] << 4);
+        } else if (code == 49) {
+            currentAttr &= ~BG_MASK;
+        } else if (code >= 90 && code <= 97) {
+            currentAttr = (currentAttr & ~FG_MASK) | ANSI_TO_CONSOLE[code - 90] | FOREGROUND_INTENSITY;
+        } else if (code >= 100 && code <= 107) {
+            currentAttr = (currentAttr & ~BG_MASK) | ((ANSI_TO_CONSOLE[code - 100] | FOREGROUND_INTENSITY) << 4);
+        } else if (code == 38 || code == 48) {
+            // 38;5;n and 38;2;r;g;b, folded onto the console palette
+            uint16_t color;
+            if (p.param(i + 1, 0) == 5) {
+                color = xterm_256_color(std::min(p.param(i + 2, 0), 255));
+                i += 2;
+            } else if (p.param(i + 1, 0) == 2) {
+                color = nearest_console_color(p.param(i + 2, 0), p.param(i + 3, 0), p.param(i + 4, 0));
+                i += 4;
             } else {
-                std::vector<int> codes;
-                std::string num;
-                for (char p : paramBuffer) {
-                    if (p == ';') {
-                        if (!num.empty()) codes.push_back(std::stoi(num));
-                        num.clear();
-                    } else {
-                        num += p;
-                    }
-                }
-                if (!num.empty()) codes.push_back(std::stoi(num));
-                
-                if (codes.empty()) codes.push_back(0); // Default 0 if empty params
-                
-                for (int code : codes) {
-                    if (code == 0) {
-                        currentAttr = 0x07;
-                    } else if (code == 1) {
-                        currentAttr |= FOREGROUND_INTENSITY;
-                    } else if (code >= 30 && code <= 37) {
-                        // clear fg
-                        currentAttr &= ~(FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
-                        // map 30-37 to windows attributes
-                        // 30=Black, 31=Red, 32=Green, 33=Yellow, 34=Blue, 35=Magenta, 36=Cyan, 37=White
-                        if (code == 31) currentAttr |= FOREGROUND_RED;
-                        else if (code == 32) currentAttr |= FOREGROUND_GREEN;
-                        else if (code == 33) currentAttr |= (FOREGROUND_RED | FOREGROUND_GREEN);
-                        else if (code == 34) currentAttr |= FOREGROUND_BLUE;
-                        else if (code == 35) currentAttr |= (FOREGROUND_RED | FOREGROUND_BLUE);
-                        else if (code == 36) currentAttr |= (FOREGROUND_GREEN | FOREGROUND_BLUE);
-                        else if (code == 37) currentAttr |= (FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
-                    } else if (code >= 90 && code <= 97) {
-                         // Bright colors (same mapping + intensity)
-                        currentAttr &= ~(FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE); // clear base
-                        currentAttr |= FOREGROUND_INTENSITY;
-                        int base = code - 60; // Map 9x back to 3x range logic approx
-                        if (base == 31) currentAttr |= FOREGROUND_RED;
-                        else if (base == 32) currentAttr |= FOREGROUND_GREEN;
-                        else if (base == 33) currentAttr |= (FOREGROUND_RED | FOREGROUND_GREEN);
-                        else if (base == 34) currentAttr |= FOREGROUND_BLUE;
-                        else if (base == 35) currentAttr |= (FOREGROUND_RED | FOREGROUND_BLUE);
-                        else if (base == 36) currentAttr |= (FOREGROUND_GREEN | FOREGROUND_BLUE);
-                        else if (base == 37) currentAttr |= (FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
-                    }
-                }
+                break;
             }
-            state = NORMAL;
-        } else {
-            state = NORMAL; 
+            if (code == 38) currentAttr = (currentAttr & ~FG_MASK) | color;
+            else currentAttr = (currentAttr & ~BG_MASK) | (color << 4);
         }
     }
 }
@@ -222,27 +672,110 @@ void Pane::backspace() {
         cx--;
         GridCell empty; 
         empty.attr = currentAttr;
-        int abs_y = 0;
-        if (grid->lines.size() < (size_t)grid->sy) {
-             abs_y = cy;
-        } else {
-             abs_y = (grid->lines.size() - grid->sy) + cy;
-        }
-        grid->write_cell(cx, abs_y, empty);
+        grid->write_cell(cx, cy, empty);
     } else if (cx == 0 && cy > 0) {
         
     }
 }
 
 void Pane::scroll(int delta) {
+    if (delta > 0) loadSkippedHistory();
+    int old = scrollOffset;
     scrollOffset += delta;
     if (scrollOffset < 0) scrollOffset = 0;
+    if (scrollOffset != old) grid->mark_all_dirty();
 }
 
 void Pane::resetScroll() {
+    if (scrollOffset != 0) grid->mark_all_dirty();
     scrollOffset = 0;
 }
 
+void Pane::append_raw(const std::string& text) {
+    rawLog += text;
+    if (rawLog.size() <= RAW_LOG_LIMIT) return;
+
+    // Keep the newest three quarters, starting on a line so a later parse
+    // does not begin inside an escape sequence.
+    size_t cut = rawLog.size() - RAW_LOG_LIMIT * 3 / 4;
+    size_t nl = rawLog.find('\n', cut);
+    if (nl != std::string::npos) cut = nl + 1;
+    rawLog.erase(0, cut);
+    rawLogTrimmed = true;
+}
+
+void Pane::setDetached(bool on) {
+    if (on == detached) return;
+    detached = on;
+    if (!on) loadPendingSnapshot(); // The log goes on after it
+    if (on || rawLog.empty()) return;
+
+    // Start of the last sy lines of the log
+    size_t start = rawLog.size();
+    int lines = 0;
+    while (start > 0) {
+        if (rawLog[start - 1] == '\n' && ++lines > grid->sy) break;
+        start--;
+    }
+
+    if (start > 0 || rawLogTrimmed) {
+        // Too much to replay: what was on screen becomes history and the
+        // tail is parsed onto a blank screen. The part in between is kept
+        // until someone scrolls back to it.
+        loadSkippedHistory();
+        grid->flush_screen(std::min(cy + 1, grid->sy));
+        cx = 0;
+        cy = 0;
+        parser.reset();
+        utf8Left = 0;
+        currentAttr = 0x07;
+        skippedLog.assign(rawLog, 0, start);
+        skippedAt = grid->hbase + grid->hsize;
+        rawLog.erase(0, start);
+    }
+
+    std::string log;
+    log.swap(rawLog);
+    rawLogTrimmed = false;
+    write(log);
+}
+
+void Pane::loadSkippedHistory() {
+    if (skippedLog.empty()) return;
+
+    int at = (int)(skippedAt - grid->hbase);
+    if (at >= 0) {
+        // Parsed on its own, as it would have appeared on a screen this size
+        Pane scratch(grid->sx, grid->sy);
+        scratch.grid->set_history_limit(grid->hlimit);
+        scratch.write(skippedLog);
+        int lines = scratch.grid->hsize + scratch.cy + (scratch.cx > 0 ? 1 : 0);
+        grid->insert_history(at, *scratch.grid, lines);
+    }
+    std::string().swap(skippedLog);
+}
+
+void Pane::setPendingSnapshot(std::shared_ptr<MappedFile> file, size_t offset, size_t length) {
+    pendingFile = std::move(file);
+    pendingOffset = offset;
+    pendingLength = length;
+}
+
+void Pane::loadPendingSnapshot() {
+    if (!pendingFile) return;
+    std::shared_ptr<MappedFile> file = std::move(pendingFile);
+    std::string error;
+    if (!PaneSnapshot::read(*this, file->data() + pendingOffset, pendingLength, error)) {
+        write("\033[31mMinsh: pane could not be restored: " + error + "\033[0m\n");
+    }
+}
+
+void Pane::setHistoryLimit(int lines) {
+    grid->set_history_limit(lines);
+    if (scrollOffset > grid->hsize) scrollOffset = grid->hsize;
+    grid->mark_all_dirty();
+}
+
 // ---- Manual Editing Implementations ----
 
 void Pane::insertChar(char c) {
@@ -300,6 +833,51 @@ void Pane::deleteCharForward() {
     }
 }
 
+void Pane::redrawInputArea(int cursorAt, int oldLength, const std::string& text) {
+    for (int i = 0; i < cursorAt; ++i) {
+        if (cx > 0) cx--;
+        else if (cy > 0) { cy--; cx = grid->sx - 1; }
+    }
+    for (char c : text) put_char(c);
+    int pad = oldLength - (int)text.length();
+    for (int i = 0; i < pad; ++i) put_char(' ');
+    for (int i = 0; i < pad; ++i) {
+        if (cx > 0) cx--;
+        else if (cy > 0) { cy--; cx = grid->sx - 1; }
+    }
+}
+// Clipped to the cells left on screen, so the ghost text never scrolls.
+void Pane::showSuggestion(const std::string& text) {
+    hideSuggestion();
+    int room = (grid->sy - 1 - cy) * grid->sx + (grid->sx - cx);
+    size_t len = 0;
+    int cells = 0;
+    while (len < text.size() && cells < room) {
+        len++;
+        while (len < text.size() && ((unsigned char)text[len] & 0xC0) == 0x80) len++; // Whole UTF-8 sequences
+        cells++;
+    }
+
+    int x = cx, y = cy;
+    uint16_t attr = currentAttr;
+    currentAttr = FOREGROUND_INTENSITY;
+    for (size_t i = 0; i < len; ++i) put_char(text[i]);
+    cx = x; cy = y;
+    currentAttr = attr;
+
+    suggestion = text;
+    suggestionShown = cells;
+}
+
+void Pane::hideSuggestion() {
+    int room = (grid->sy - 1 - cy) * grid->sx + (grid->sx - cx);
+    int x = cx, y = cy;
+    for (int i = 0; i < suggestionShown && i < room; ++i) put_char(' ');
+    cx = x; cy = y;
+    suggestion.clear();
+    suggestionShown = 0;
+}
+
 void Pane::moveCursor(int delta) {
     int newPos = inputCursor + delta;
     if (newPos < 0) newPos = 0;
@@ -5,8 +5,25 @@
 #include <string>
 #include <memory>
 #include <cstdint>
-#include <windows.h>
 #include "ShellSession.hpp"
+#include "VtParser.hpp"
+
+class MappedFile;
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+// Cell attributes keep the Windows console bit layout on every platform;
+// the renderers translate them.
+#define FOREGROUND_BLUE      0x0001
+#define FOREGROUND_GREEN     0x0002
+#define FOREGROUND_RED       0x0004
+#define FOREGROUND_INTENSITY 0x0008
+#define BACKGROUND_BLUE      0x0010
+#define BACKGROUND_GREEN     0x0020
+#define BACKGROUND_RED       0x0040
+#define BACKGROUND_INTENSITY 0x0080
+#endif
 #include <chrono>
 
 struct GridCell {
@@ -17,28 +34,83 @@ struct GridCell {
     GridCell() : data(' '), attr(0x07), flags(0) {}
 };
 
-struct GridLine {
-    std::vector<GridCell> cells;
-    int flags;
-    
-    GridLine(int width) : cells(width), flags(0) {}
+// A line that has scrolled off the screen, frozen into trimmed UTF-8 text
+// followed by packed attribute runs (attr, flags, cell count). Trailing
+// blank cells are dropped and come back as blanks when the line is expanded.
+struct CompactLine {
+    std::string bytes;
+    uint32_t textLen = 0;
 };
 
+// Only the visible sy rows are kept as full GridCell rows, in a ring over
+// one contiguous slab: screen row y lives at slab row (first + y) % sy.
+// History is a ring of CompactLines; line 0 of the grid is the oldest
+// history line and line hsize is the top of the screen.
 class Grid {
+    friend class PaneSnapshot;
+
 public:
-    Grid(int sx, int sy);
+    static const int DEFAULT_HISTORY_LIMIT = 20000;
+
+    Grid(int sx, int sy, int hlimit = DEFAULT_HISTORY_LIMIT);
     ~Grid();
 
     int sx;
     int sy;
-    int hsize;
+    int hsize;  // lines scrolled off the top, 0..hlimit
+    int hlimit;
+    long long hbase = 0; // lines dropped off the oldest end so far
 
-    std::vector<std::unique_ptr<GridLine>> lines;
-    
-    void resize(int new_sx, int new_sy);
+    int total_lines() const { return hsize + sy; }
+    GridCell* screen_line(int y);
+    const GridCell* screen_line(int y) const;
+    const GridCell* view_line(int y, std::vector<GridCell>& scratch) const;
+
+    int resize(int new_sx, int new_sy, int cursor_y);
+    void set_history_limit(int new_hlimit);
     void write_cell(int x, int y, const GridCell& cell);
+    // Writes n single-byte characters from x on, clipped at the row end.
+    void write_run(int x, int y, const char* text, int n, uint16_t attr);
+    // Row edits for erase/insert/delete sequences; x1 is exclusive.
+    void clear_cells(int y, int x0, int x1, uint16_t attr);
+    void insert_cells(int y, int x, int n, uint16_t attr);
+    void delete_cells(int y, int x, int n, uint16_t attr);
     const GridCell& get_cell(int x, int y) const;
     void scroll_up();
+    // Moves the first rows screen rows into history and blanks the screen.
+    void flush_screen(int rows);
+    // Inserts the first lines lines of src (same width) into history before
+    // history line at, dropping the oldest lines past hlimit.
+    void insert_history(int at, const Grid& src, int lines);
+
+    // Damage tracking, one flag per screen row. Scrolling or resizing moves
+    // every row, so it marks the whole grid; the renderer clears the flags
+    // once it has composed the grid. scrolled says history moved too, which
+    // the row flags do not cover.
+    bool is_dirty() const { return damaged; }
+    bool scrolled() const { return historyMoved; }
+    bool row_dirty(int y) const { return rowDirty[y] != 0; }
+    void mark_dirty(int y) { rowDirty[y] = 1; damaged = true; }
+    void mark_all_dirty();
+    void clear_dirty();
+
+private:
+    std::vector<GridCell> cells; // sy * sx
+    int first;                   // slab row holding screen row 0
+    std::vector<uint8_t> rowDirty;
+    bool damaged;
+    bool historyMoved = false;
+
+    std::vector<CompactLine> history; // grows to hlimit, then used as a ring
+    int hfirst;                       // slot holding the oldest history line
+
+    CompactLine& history_slot(int y) { return history[(hfirst + y) % history.size()]; }
+    const CompactLine& history_slot(int y) const { return history[(hfirst + y) % history.size()]; }
+    void push_history(const GridCell* row);
+    void pop_history(GridCell* row, int width);
+    void freeze(const GridCell* row, CompactLine& out);
+    void expand(const CompactLine& line, GridCell* row, int width) const;
+    void clear_screen_line(int y);
 };
 
 class Pane {
@@ -62,6 +134,26 @@ public:
 
     bool waitingForProcess = false; // Added for prompt management
     std::chrono::steady_clock::time_point detachTime; // Track when detached
+
+    // Output flood control: set while the child produces more than the
+    // per-tick budget. The multiplexer then paints the pane less often and
+    // shows a marker on it.
+    bool throttled = false;
+    bool throttleMarker = false; // Marker currently on screen
+    std::chrono::steady_clock::time_point lastPaint;
+
+    // Reverse history search (Ctrl+R). While active, the text after the
+    // prompt shows the search line instead of currentInput.
+    bool searching = false;
+    std::string searchQuery;
+    int searchMatch = -1;          // HistoryStore index, -1 when none
+    bool searchFailed = false;     // Query has no match (older than searchMatch)
+    std::string searchSavedInput;  // Restored by Ctrl+G
+    int searchShown = 0;           // Cells of the search line on screen
+
+    // History suggestion shown dimmed after the input (accepted by Right/End)
+    std::string suggestion;
+    int suggestionShown = 0;       // Cells of it on screen
     
     void write(const std::string& text);
     void resize(int w, int h);
@@ -75,22 +167,65 @@ public:
     void deleteChar();
     void deleteCharForward();
     void moveCursor(int delta);
+    // Replaces the oldLength cells drawn after the prompt (cursor cursorAt
+    // cells into them) with text, leaving the cursor after it.
+    void redrawInputArea(int cursorAt, int oldLength, const std::string& text);
+    // Draw or erase the suggestion after the cursor without moving it
+    void showSuggestion(const std::string& text);
+    void hideSuggestion();
     
     void backspace(); // Low level display backspace
     
     void scroll(int delta);
     void resetScroll();
+    void setHistoryLimit(int lines);
+
+    // A detached pane is not visible, so write() only appends to a bounded
+    // raw log. Attaching parses just the tail that rebuilds the screen; the
+    // older part of the log is parsed into history once scrollback is
+    // asked for (loadSkippedHistory).
+    static const size_t RAW_LOG_LIMIT = 2 * 1024 * 1024;
+    void setDetached(bool on);
+    bool isDetached() const { return detached; }
+    void loadSkippedHistory();
+
+    // A pane restored from a workspace leaves its snapshot in the mapped
+    // file until it is first shown, attached or written to.
+    void setPendingSnapshot(std::shared_ptr<MappedFile> file, size_t offset, size_t length);
+    void loadPendingSnapshot();
     
 private:
+    friend class VtParser;
+    friend class PaneSnapshot;
+
     uint16_t currentAttr;
-    enum AnsiState {
-        NORMAL,
-        ESC,
-        CSI,
-        PARAM
-    } state;
-    std::string paramBuffer;
-    void handleAnsi(char c);
+    VtParser parser;
+    uint32_t utf8Code = 0;
+    int utf8Left = 0; // Continuation bytes still expected
+    int savedX = 0, savedY = 0;
+    uint16_t savedAttr = 0x07;
+
+    bool detached = false;
+    std::string rawLog;        // Output received while detached
+    bool rawLogTrimmed = false;
+    std::string skippedLog;    // Log older than the tail parsed on attach
+    long long skippedAt = 0;   // Where it belongs, as Grid::hbase + line
+
+    std::shared_ptr<MappedFile> pendingFile;
+    size_t pendingOffset = 0;
+    size_t pendingLength = 0;
+
+    void write_run(const char* text, size_t len);
+    void append_raw(const std::string& text);
+    void put_glyph(uint32_t ch);
+    uint16_t erase_attr() const;
+    void select_graphic_rendition(const VtParser& p);
+
+    // VtParser events
+    void vtPrint(unsigned char c);
+    void vtExecute(unsigned char c);
+    void vtEscDispatch(const VtParser& p, unsigned char final);
+    void vtCsiDispatch(const VtParser& p, unsigned char final);
 };
 
 #endif // PANES_HPP
@@ -0,0 +1,277 @@
+#include "Renderer.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// ---- Frame ----
+
+void Frame::reset(int c, int r) {
+    cols = c;
+    rows = r;
+    FrameCell blank = { ' ', 0x07 };
+    cells.assign((size_t)cols * rows, blank);
+    damageLeft.assign(rows, 0);
+    damageRight.assign(rows, cols - 1);
+}
+
+void Frame::markDamage(int y, int x0, int x1) {
+    if (y < 0 || y >= rows) return;
+    if (x0 < 0) x0 = 0;
+    if (x1 >= cols) x1 = cols - 1;
+    if (x0 > x1) return;
+    if (x0 < damageLeft[y]) damageLeft[y] = x0;
+    if (x1 > damageRight[y]) damageRight[y] = x1;
+}
+
+bool Frame::hasDamage() const {
+    for (int y = 0; y < rows; ++y) {
+        if (rowDamaged(y)) return true;
+    }
+    return false;
+}
+
+void Frame::clearDamage() {
+    std::fill(damageLeft.begin(), damageLeft.end(), cols);
+    std::fill(damageRight.begin(), damageRight.end(), -1);
+}
+
+// ---- VtRenderer ----
+
+namespace {
+
+const char* SYNC_BEGIN = "\033[?2026h";
+const char* SYNC_END = "\033[?2026l";
+
+// Cells that can be rewritten instead of jumping over them; a cursor move
+// costs about as many bytes.
+const int MAX_REWRITE_GAP = 4;
+
+void appendNumber(std::string& out, int n) {
+    char buf[16];
+    int len = 0;
+    do {
+        buf[len++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n > 0);
+    while (len > 0) out += buf[--len];
+}
+
+// Console colour bits are BGR; ANSI colour indexes are RGB.
+int ansiColor(int bits) {
+    return ((bits & 0x4) ? 1 : 0) | ((bits & 0x2) ? 2 : 0) | ((bits & 0x1) ? 4 : 0);
+}
+
+void writeStdout(const char* data, size_t len) {
+#ifdef _WIN32
+    HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
+    while (len > 0) {
+        DWORD written = 0;
+        if (!WriteFile(h, data, (DWORD)len, &written, NULL) || written == 0) return;
+        data += written;
+        len -= written;
+    }
+#else
+    while (len > 0) {
+        ssize_t n = ::write(STDOUT_FILENO, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+#endif
+}
+
+}
+
+VtRenderer::VtRenderer(Sink s) : sink(s ? s : Sink(writeStdout)) {}
+
+void VtRenderer::moveTo(int x, int y) {
+    if (x == curX && y == curY) return;
+    if (x == 0 && curY >= 0 && y == curY + 1) {
+        out += "\r\n";
+    } else if (y == curY && curX >= 0 && x > curX) {
+        out += "\033[";
+        appendNumber(out, x - curX);
+        out += 'C';
+    } else {
+        out += "\033[";
+        appendNumber(out, y + 1);
+        out += ';';
+        appendNumber(out, x + 1);
+        out += 'H';
+    }
+    curX = x;
+    curY = y;
+}
+
+void VtRenderer::setAttr(uint16_t attr) {
+    if (attr == curAttr) return;
+    curAttr = attr;
+
+    out += "\033[0";
+    int fg = attr & 0x0F;
+    int bg = (attr >> 4) & 0x0F;
+    if (fg != 0x07) {
+        out += ';';
+        appendNumber(out, ((fg & 0x8) ? 90 : 30) + ansiColor(fg));
+    }
+    if (bg != 0) {
+        out += ';';
+        appendNumber(out, ((bg & 0x8) ? 100 : 40) + ansiColor(bg));
+    }
+    if (attr & 0x8000) out += ";4"; // COMMON_LVB_UNDERSCORE
+    if (attr & 0x4000) out += ";7"; // COMMON_LVB_REVERSE_VIDEO
+    out += 'm';
+}
+
+void VtRenderer::putCell(const FrameCell& cell) {
+    setAttr(cell.attr);
+    uint32_t cp = cell.ch;
+    if (cp < 32 || cp == 0x7F) cp = ' ';
+    if (cp < 0x80) {
+        out += (char)cp;
+    } else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    // Writing the last column leaves the terminal in its pending-wrap state,
+    // so the column is unknown until the next explicit move.
+    if (curX >= 0) curX++;
+    if (curX >= cols) curX = -1;
+}
+
+void VtRenderer::diffRow(const Frame& frame, int y) {
+    const FrameCell* next = &frame.cells[(size_t)y * cols];
+    FrameCell* prev = &previous[(size_t)y * cols];
+    int right = frame.damageRight[y];
+    int x = frame.damageLeft[y];
+
+    while (x <= right) {
+        if (next[x] == prev[x]) { ++x; continue; }
+
+        moveTo(x, y);
+        while (x <= right) {
+            if (next[x] == prev[x]) {
+                // Bridge a short gap of unchanged cells in the current
+                // attribute rather than paying for another cursor move.
+                int gap = 0;
+                while (x + gap <= right && gap <= MAX_REWRITE_GAP &&
+                       next[x + gap] == prev[x + gap] && next[x + gap].attr == curAttr) {
+                    gap++;
+                }
+                if (gap > MAX_REWRITE_GAP || x + gap > right || next[x + gap] == prev[x + gap]) break;
+                for (int i = 0; i < gap; ++i) putCell(next[x + i]);
+                x += gap;
+            }
+            putCell(next[x]);
+            prev[x] = next[x];
+            ++x;
+        }
+    }
+}
+
+void VtRenderer::present(const Frame& frame, int cursorX, int cursorY) {
+    if (frame.cols != cols || frame.rows != rows) {
+        // Nothing on screen can be trusted after a resize.
+        cols = frame.cols;
+        rows = frame.rows;
+        FrameCell unknown = { 0xFFFFFFFF, 0 };
+        previous.assign((size_t)cols * rows, unknown);
+        curX = curY = -1;
+        curAttr = -1;
+        shownX = shownY = -1;
+    }
+
+    out.clear();
+    out += SYNC_BEGIN;
+    size_t header = out.size();
+
+    for (int y = 0; y < rows; ++y) {
+        if (frame.rowDamaged(y)) diffRow(frame, y);
+    }
+
+    if (out.size() == header && cursorX == shownX && cursorY == shownY) return;
+
+    moveTo(cursorX, cursorY);
+    out += SYNC_END;
+    sink(out.data(), out.size());
+    shownX = cursorX;
+    shownY = cursorY;
+}
+
+// ---- ConsoleRenderer ----
+
+#ifdef _WIN32
+ConsoleRenderer::ConsoleRenderer() {
+    hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+}
+
+void ConsoleRenderer::present(const Frame& frame, int cursorX, int cursorY) {
+    buffer.resize((size_t)frame.cols * frame.rows);
+    COORD bufSize = { (SHORT)frame.cols, (SHORT)frame.rows };
+
+    // Emit each band of consecutive damaged rows as one rectangle.
+    int y = 0;
+    while (y < frame.rows) {
+        if (!frame.rowDamaged(y)) { ++y; continue; }
+        int y0 = y;
+        int x0 = frame.damageLeft[y];
+        int x1 = frame.damageRight[y];
+        while (y < frame.rows && frame.rowDamaged(y)) {
+            x0 = std::min(x0, frame.damageLeft[y]);
+            x1 = std::max(x1, frame.damageRight[y]);
+            ++y;
+        }
+        for (int by = y0; by < y; ++by) {
+            for (int bx = x0; bx <= x1; ++bx) {
+                size_t i = (size_t)by * frame.cols + bx;
+                buffer[i].Char.UnicodeChar = (WCHAR)frame.cells[i].ch;
+                buffer[i].Attributes = frame.cells[i].attr;
+            }
+        }
+        COORD bufCoord = { (SHORT)x0, (SHORT)y0 };
+        SMALL_RECT writeRegion = { (SHORT)x0, (SHORT)y0, (SHORT)x1, (SHORT)(y - 1) };
+        WriteConsoleOutputW(hOut, buffer.data(), bufSize, bufCoord, &writeRegion);
+    }
+
+    if (cursorX != shownX || cursorY != shownY) {
+        COORD c; c.X = (SHORT)cursorX; c.Y = (SHORT)cursorY;
+        SetConsoleCursorPosition(hOut, c);
+        shownX = cursorX;
+        shownY = cursorY;
+    }
+}
+#endif
+
+std::unique_ptr<Renderer> createRenderer() {
+    const char* choice = std::getenv("MINSH_RENDERER");
+#ifdef _WIN32
+    if (choice && std::strcmp(choice, "vt") == 0) {
+        HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+        DWORD mode = 0;
+        GetConsoleMode(hOut, &mode);
+        SetConsoleMode(hOut, mode | ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+        return std::make_unique<VtRenderer>();
+    }
+    return std::make_unique<ConsoleRenderer>();
+#else
+    (void)choice;
+    return std::make_unique<VtRenderer>();
+#endif
+}
@@ -0,0 +1,98 @@
+#ifndef RENDERER_HPP
+#define RENDERER_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// One composed screen cell. attr uses the console attribute bits
+// (FOREGROUND_*/BACKGROUND_*) that the rest of MinSh stores in GridCell.
+struct FrameCell {
+    uint32_t ch;
+    uint16_t attr;
+
+    bool operator==(const FrameCell& o) const { return ch == o.ch && attr == o.attr; }
+    bool operator!=(const FrameCell& o) const { return !(*this == o); }
+};
+
+// The composed screen plus the columns that changed since the last present,
+// per row (nothing changed when left > right).
+struct Frame {
+    int cols = 0;
+    int rows = 0;
+    std::vector<FrameCell> cells;
+    std::vector<int> damageLeft;
+    std::vector<int> damageRight;
+
+    void reset(int c, int r);
+    void markDamage(int y, int x0, int x1);
+    bool rowDamaged(int y) const { return damageLeft[y] <= damageRight[y]; }
+    bool hasDamage() const;
+    void clearDamage();
+};
+
+class Renderer {
+public:
+    virtual ~Renderer() {}
+    // Pushes the damaged parts of the frame to the terminal and leaves the
+    // cursor at (cursorX, cursorY).
+    virtual void present(const Frame& frame, int cursorX, int cursorY) = 0;
+};
+
+// Renders through ANSI/VT escape sequences. Keeps the last frame it emitted
+// and only sends cursor moves, SGR changes and runs of changed cells, all in
+// a single write per frame wrapped in synchronized output (DEC mode 2026).
+// The sink receives the bytes; by default they go to stdout.
+class VtRenderer : public Renderer {
+public:
+    typedef std::function<void(const char* data, size_t len)> Sink;
+
+    explicit VtRenderer(Sink sink = Sink());
+    void present(const Frame& frame, int cursorX, int cursorY) override;
+
+private:
+    Sink sink;
+    std::string out;
+    std::vector<FrameCell> previous;
+    int cols = 0;
+    int rows = 0;
+
+    // What the terminal is known to show; -1 when unknown.
+    int curX = -1;
+    int curY = -1;
+    int curAttr = -1;
+    int shownX = -1;
+    int shownY = -1;
+
+    void moveTo(int x, int y);
+    void setAttr(uint16_t attr);
+    void putCell(const FrameCell& cell);
+    void diffRow(const Frame& frame, int y);
+};
+
+#ifdef _WIN32
+// Renders with WriteConsoleOutputW, one call per band of damaged rows.
+class ConsoleRenderer : public Renderer {
+public:
+    ConsoleRenderer();
+    void present(const Frame& frame, int cursorX, int cursorY) override;
+
+private:
+    HANDLE hOut;
+    std::vector<CHAR_INFO> buffer;
+    int shownX = -1;
+    int shownY = -1;
+};
+#endif
+
+// Picks the backend from MINSH_RENDERER ("vt" or "console"). Defaults to the
+// console backend on Windows and VT elsewhere.
+std::unique_ptr<Renderer> createRenderer();
+
+#endif // RENDERER_HPP
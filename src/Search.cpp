@@ -0,0 +1,201 @@
+#include "Search.hpp"
+#include "Matcher.hpp"
+#include "MappedFile.hpp"
+#include "WorkStealing.hpp"
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const unsigned MAX_THREADS = 16;
+
+// Output is handed to the job in batches of about this size
+const size_t BATCH_BYTES = 16 * 1024;
+
+// Longest part of a matching line that is printed
+const size_t MAX_LINE_BYTES = 400;
+
+// Files with a NUL in their first bytes are taken to be binary and skipped
+const size_t BINARY_PROBE_BYTES = 8192;
+
+const char* PATH_COLOR = "\033[35m";
+const char* LINE_COLOR = "\033[32m";
+const char* MATCH_COLOR = "\033[31m";
+const char* RESET = "\033[0m";
+
+struct Item {
+    std::string rel;  // Relative to the root, "" for the root itself
+    bool dir;
+};
+
+class Walker {
+public:
+    Walker(Job& job, const Search::Options& options, const Matcher& matcher, unsigned threads)
+        : job(job), options(options), pool(threads),
+          matchers(threads, matcher), // scan() is not const (regex DFAs grow), so one each
+          outs(threads) {}
+
+    void run() {
+        pool.push(0, Item{"", true});
+        pool.run(
+            [this](unsigned self, const Item& item) {
+                if (item.dir) visitDirectory(self, item.rel);
+                else visitFile(self, item.rel);
+            },
+            [this](unsigned self) { flush(self); },
+            [this] { return job.cancelled(); });
+        for (unsigned i = 0; i < pool.threads(); ++i) flush(i);
+    }
+
+    std::atomic<size_t> matches{0};
+
+private:
+    Job& job;
+    const Search::Options& options;
+    WorkStealingPool<Item> pool;
+    std::vector<Matcher> matchers;
+    std::vector<std::string> outs;
+
+    void flush(unsigned self) {
+        if (outs[self].empty()) return;
+        job.write(outs[self]);
+        outs[self].clear();
+    }
+
+    void emit(std::string& out) {
+        if (out.size() < BATCH_BYTES) return;
+        job.write(out);
+        out.clear();
+    }
+
+    void visitDirectory(unsigned self, const std::string& rel) {
+        Matcher& local = matchers[self];
+        std::string& out = outs[self];
+        std::error_code ec;
+        fs::path dir = rel.empty() ? fs::path(options.root) : fs::path(options.root) / rel;
+        fs::directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec);
+        for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+            if (job.cancelled()) return;
+            std::string name = it->path().filename().string();
+            if (!options.hidden && name[0] == '.') continue;
+
+            std::string child = rel.empty() ? name : rel + (char)fs::path::preferred_separator + name;
+            // Symlinked directories are listed but not followed, so loops end
+            std::error_code typeEc;
+            bool isDir = it->is_directory(typeEc) && !it->is_symlink(typeEc);
+
+            size_t shown = 0;
+            local.scan(name.data(), name.size(), [&](size_t from, size_t to) {
+                if (shown == 0) {
+                    out += PATH_COLOR;
+                    out.append(child, 0, child.size() - name.size());
+                }
+                out.append(name, shown, from - shown);
+                out += MATCH_COLOR;
+                out.append(name, from, to - from);
+                out += PATH_COLOR;
+                shown = to;
+            });
+            if (shown > 0) {
+                out.append(name, shown, std::string::npos);
+                if (isDir) out += (char)fs::path::preferred_separator;
+                out += RESET;
+                out += '\n';
+                matches++;
+                emit(out);
+            }
+
+            if (isDir) pool.push(self, Item{child, true});
+            else if (options.contents && it->is_regular_file(typeEc)) pool.push(self, Item{child, false});
+        }
+    }
+
+    void visitFile(unsigned self, const std::string& rel) {
+        if (job.cancelled()) return;
+        Matcher& local = matchers[self];
+        std::string& out = outs[self];
+        MappedFile file((fs::path(options.root) / rel).string());
+        if (!file.ok() || file.size() == 0) return;
+        const char* data = file.data();
+        size_t len = file.size();
+        if (memchr(data, 0, std::min(len, BINARY_PROBE_BYTES))) return;
+
+        // The line being printed, and how much of it is out already
+        size_t lineStart = 0;
+        size_t lineEnd = 0;
+        size_t lineCut = 0;
+        size_t copied = 0;
+        size_t lineNo = 1;
+        size_t counted = 0; // Newlines before this offset are in lineNo
+        bool open = false;
+
+        auto closeLine = [&]() {
+            if (!open) return;
+            out.append(data + copied, lineCut - copied);
+            if (lineCut < lineEnd) out += "...";
+            out += '\n';
+            open = false;
+            emit(out);
+        };
+
+        local.scan(data, len, [&](size_t from, size_t to) {
+            if (!open || from >= lineEnd) {
+                closeLine();
+                lineStart = from;
+                while (lineStart > 0 && data[lineStart - 1] != '\n') lineStart--;
+                const char* nl = static_cast<const char*>(memchr(data + from, '\n', len - from));
+                lineEnd = nl ? nl - data : len;
+                if (lineEnd > lineStart && data[lineEnd - 1] == '\r') lineEnd--;
+                lineCut = std::min(lineEnd, lineStart + MAX_LINE_BYTES);
+                while (counted < lineStart) {
+                    const char* nl = static_cast<const char*>(memchr(data + counted, '\n', lineStart - counted));
+                    if (!nl) break;
+                    lineNo++;
+                    counted = nl - data + 1;
+                }
+                copied = lineStart;
+                open = true;
+                matches++;
+
+                out += PATH_COLOR;
+                out += rel;
+                out += RESET;
+                out += ':';
+                out += LINE_COLOR;
+                out += std::to_string(lineNo);
+                out += RESET;
+                out += ": ";
+            }
+            if (from >= lineCut) return;
+            to = std::min(to, lineCut);
+            out.append(data + copied, from - copied);
+            out += MATCH_COLOR;
+            out.append(data + from, to - from);
+            out += RESET;
+            copied = to;
+        });
+        closeLine();
+    }
+};
+
+}
+
+void Search::run(Job& job, const Options& options) {
+    Matcher matcher;
+    matcher.addLiteral(options.pattern);
+    matcher.setIgnoreCase(options.ignoreCase);
+    std::string error;
+    matcher.compile(error); // Literals always compile
+
+    unsigned threads = std::max(1u, std::min(MAX_THREADS, std::thread::hardware_concurrency()));
+    Walker walker(job, options, matcher, threads);
+    walker.run();
+
+    if (job.cancelled()) job.write("^C\n");
+    else if (walker.matches == 0) job.write("search: no matches\n");
+}
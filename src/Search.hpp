@@ -0,0 +1,25 @@
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+#include <string>
+#include "Job.hpp"
+
+// The `search` builtin: walks a directory tree on a pool of threads and
+// reports paths whose name contains the pattern and, optionally, lines
+// inside files that do. Each thread keeps its own queue of directories
+// and files to visit and steals from the others when it runs dry.
+class Search {
+public:
+    struct Options {
+        std::string pattern;
+        std::string root;         // Directory to walk; paths are shown relative to it
+        bool contents = false;    // Also look inside files
+        bool ignoreCase = false;
+        bool hidden = false;      // Visit names starting with '.'
+    };
+
+    // Writes matches to job as they are found; returns early on Ctrl+C.
+    static void run(Job& job, const Options& options);
+};
+
+#endif // SEARCH_HPP
@@ -3,6 +3,10 @@
 // Execute: bin/minsh
 
 #include "Sessions.hpp"
+#include "Panes.hpp"
+#include "Multiplex.hpp"
+#include "PaneSnapshot.hpp"
+#include "MappedFile.hpp"
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -13,6 +17,32 @@ namespace fs = std::filesystem;
 
 std::filesystem::path SessionManager::sessionRoot;
 
+namespace {
+
+// Written aside and renamed over, so a failed write leaves the old file
+// whole
+bool replaceFile(const fs::path& filename, const std::string& bytes) {
+    fs::path temp = filename;
+    temp += ".tmp";
+    std::error_code ec;
+    {
+        std::ofstream outfile(temp, std::ios::binary | std::ios::trunc);
+        if (!outfile) return false;
+        outfile.write(bytes.data(), bytes.size());
+        outfile.close();
+        if (!outfile) {
+            fs::remove(temp, ec);
+            return false;
+        }
+    }
+    fs::rename(temp, filename, ec);
+    if (!ec) return true;
+    fs::remove(temp, ec);
+    return false;
+}
+
+}
+
 void SessionManager::init(const std::string& exePath) {
     fs::path exeDir = fs::absolute(exePath).parent_path();
     
@@ -51,37 +81,39 @@ void SessionManager::ensureSessionDirectory() {
     }
 }
 
-bool SessionManager::saveSession(const std::string& name, const std::string& content, const std::string& cwd) {
+bool SessionManager::saveSession(const std::string& name, Pane& pane) {
     ensureSessionDirectory();
     fs::path filename = getSessionDir() / (name + ".sesh");
-    std::ofstream outfile(filename);
-    if (!outfile) return false;
-    outfile << cwd << "\n";
-    outfile << content;
-    outfile.close();
-    return true;
+    std::string snapshot;
+    PaneSnapshot::write(pane, snapshot);
+    return replaceFile(filename, snapshot);
 }
 
-SessionData SessionManager::loadSession(const std::string& name) {
+bool SessionManager::loadSession(const std::string& name, Pane& pane, std::string& error) {
     ensureSessionDirectory();
     fs::path filename = getSessionDir() / (name + ".sesh");
-    std::ifstream infile(filename);
-    SessionData data;
-    if (!infile) return data;
-    
-    if (std::getline(infile, data.cwd)) {
-        // Remove \r if present (Windows)
-        if (!data.cwd.empty() && data.cwd.back() == '\r') {
-            data.cwd.pop_back();
-        }
-    } else {
-        data.cwd = "";
+    MappedFile file(filename.string());
+    if (!file.ok() || file.size() == 0) {
+        error = "session not found or empty";
+        return false;
     }
-    
-    std::string content((std::istreambuf_iterator<char>(infile)), 
-                        std::istreambuf_iterator<char>());
-    data.content = content;
-    return data;
+    if (PaneSnapshot::isSnapshot(file.data(), file.size())) {
+        return PaneSnapshot::read(pane, file.data(), file.size(), error);
+    }
+
+    // Older text session
+    std::string text(file.data(), file.size());
+    size_t nl = text.find('\n');
+    std::string cwd = text.substr(0, nl);
+    if (!cwd.empty() && cwd.back() == '\r') cwd.pop_back();
+    pane.grid = std::make_unique<Grid>(pane.grid->sx, pane.grid->sy, pane.grid->hlimit); // Clear
+    pane.cx = 0;
+    pane.cy = 0;
+    pane.cwd = cwd;
+    if (nl != std::string::npos) pane.write(text.substr(nl + 1));
+    std::error_code ec;
+    if (pane.session && fs::is_directory(cwd, ec)) pane.session->setCwd(cwd);
+    return true;
 }
 
 bool SessionManager::removeSession(const std::string& name) {
@@ -103,3 +135,33 @@ std::vector<std::string> SessionManager::listSessions() {
     }
     return sessions;
 }
+
+bool SessionManager::saveWorkspace(const std::string& name, Multiplexer& multiplexer) {
+    ensureSessionDirectory();
+    fs::path filename = getSessionDir() / (name + ".wksp");
+    std::string image;
+    multiplexer.saveWorkspace(image);
+    return replaceFile(filename, image);
+}
+
+bool SessionManager::loadWorkspace(const std::string& name, Multiplexer& multiplexer, std::string& error) {
+    ensureSessionDirectory();
+    fs::path filename = getSessionDir() / (name + ".wksp");
+    auto file = std::make_shared<MappedFile>(filename.string());
+    if (!file->ok() || file->size() == 0) {
+        error = "workspace not found or empty";
+        return false;
+    }
+    return multiplexer.loadWorkspace(file, error);
+}
+
+std::vector<std::string> SessionManager::listWorkspaces() {
+    ensureSessionDirectory();
+    std::vector<std::string> workspaces;
+    for (const auto& entry : fs::directory_iterator(getSessionDir())) {
+        if (entry.path().extension() == ".wksp") {
+             workspaces.push_back(entry.path().filename().string());
+        }
+    }
+    return workspaces;
+}
@@ -9,18 +9,23 @@
 #include <vector>
 #include <filesystem>
 
-struct SessionData {
-    std::string cwd;
-    std::string content;
-};
+class Pane;
+class Multiplexer;
 
 class SessionManager {
 public:
     static void ensureSessionDirectory();
-    static bool saveSession(const std::string& name, const std::string& content, const std::string& cwd);
-    static SessionData loadSession(const std::string& name);
+    // Sessions are PaneSnapshots. Files saved before those (a cwd line,
+    // then the pane's text) still load, replayed through the pane.
+    static bool saveSession(const std::string& name, Pane& pane);
+    static bool loadSession(const std::string& name, Pane& pane, std::string& error);
     static bool removeSession(const std::string& name);
     static std::vector<std::string> listSessions();
+
+    // Workspaces: the whole layout and every pane in one <name>.wksp file
+    static bool saveWorkspace(const std::string& name, Multiplexer& multiplexer);
+    static bool loadWorkspace(const std::string& name, Multiplexer& multiplexer, std::string& error);
+    static std::vector<std::string> listWorkspaces();
     
     static void init(const std::string& exePath);
     
@@ -4,24 +4,143 @@
 #include "Shell.h"
 #include "Utils.h"
 #include "Sessions.hpp"
+#include "HistoryStore.hpp"
+#include "Completion.hpp"
+#include "CommandCache.hpp"
+#include "MappedFile.hpp"
+#include "Matcher.hpp"
+#include "Search.hpp"
+#include "DirectoryReader.hpp"
+#include "FileOps.hpp"
 #include <iostream>
 #include <string>
 #include <vector>
 #include <sstream>
+#include <string_view>
 #include <filesystem>
 #include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
 #include "Signal.hpp"
 #include "Interrupts.hpp"
 
 namespace fs = std::filesystem;
 
+const char* const Shell::BUILTINS[] = { "exit", "help", "say", "cwd", "goto", "make", "remove", "list", "sesh", "read", "hash", "search", "copy", "move" };
+const size_t Shell::BUILTIN_COUNT = sizeof(Shell::BUILTINS) / sizeof(Shell::BUILTINS[0]);
+
+namespace {
+// Output taken from one pane per main loop tick. Anything beyond that stays
+// in the child's pipe or pty until the next tick.
+const size_t PANE_OUTPUT_BUDGET = 64 * 1024;
+
+// Tab lists at most this many candidates
+const size_t MAX_LISTED_COMPLETIONS = 200;
+
+// read hands the pane this much at a time
+const size_t READ_CHUNK = 64 * 1024;
+
+// Offset just past the first n lines of data.
+size_t afterLines(const char* data, size_t len, long long n) {
+    size_t pos = 0;
+    while (n-- > 0 && pos < len) {
+        const char* nl = static_cast<const char*>(memchr(data + pos, '\n', len - pos));
+        if (!nl) return len;
+        pos = nl - data + 1;
+    }
+    return pos;
+}
+
+// Offset where the last n lines of data start, found scanning backwards.
+size_t lastLines(const char* data, size_t len, long long n) {
+    if (n <= 0) return len;
+    size_t pos = len;
+    if (pos > 0 && data[pos - 1] == '\n') pos--; // Ends the last line
+    for (; pos > 0; --pos) {
+        if (data[pos - 1] == '\n' && --n == 0) return pos;
+    }
+    return 0;
+}
+
+// Terminal columns taken by a UTF-8 name (one per code point)
+size_t displayWidth(std::string_view name) {
+    size_t width = 0;
+    for (unsigned char c : name) {
+        if ((c & 0xC0) != 0x80) width++;
+    }
+    return width;
+}
+
+// ls style: type, then rwx for owner, group and others
+std::string modeString(const DirectoryReader::Entry& e) {
+    std::string m = "?---------";
+    switch (e.type) {
+        case DirectoryReader::REGULAR: m[0] = '-'; break;
+        case DirectoryReader::DIR: m[0] = 'd'; break;
+        case DirectoryReader::LINK: m[0] = 'l'; break;
+        default: break;
+    }
+    const char* bits = "rwxrwxrwx";
+    for (int i = 0; i < 9; ++i) {
+        if (e.mode & (0400 >> i)) m[1 + i] = bits[i];
+    }
+    return m;
+}
+
+std::string timeString(int64_t unixTime) {
+    time_t t = (time_t)unixTime;
+    char buf[32];
+    struct tm local;
+#ifdef _WIN32
+    bool ok = localtime_s(&local, &t) == 0;
+#else
+    bool ok = localtime_r(&t, &local) != nullptr;
+#endif
+    if (!ok || strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", &local) == 0) return std::string(16, '?');
+    return buf;
+}
+
+// Directories blue with a trailing separator, links cyan, executables green
+void appendEntryName(std::string& out, const DirectoryReader& dir, const DirectoryReader::Entry& e) {
+    const char* color = e.type == DirectoryReader::DIR ? "\033[1;34m"
+                      : e.type == DirectoryReader::LINK ? "\033[1;36m"
+                      : e.executable ? "\033[1;32m" : nullptr;
+    if (color) out += color;
+    out += dir.name(e);
+    if (e.type == DirectoryReader::DIR) out += (char)fs::path::preferred_separator;
+    if (color) out += "\033[0m";
+}
+
+// A path typed in pane p; jobs outlive the process's current directory
+fs::path inCwd(Pane& p, const std::string& path) {
+    return (fs::path(p.session->getCwd()) / path).lexically_normal();
+}
+
+// Like cp and mv: into dst when it is an existing directory
+fs::path destinationFor(const fs::path& from, const fs::path& dst) {
+    std::error_code ec;
+    if (!fs::is_directory(dst, ec)) return dst;
+    fs::path name = from.filename().empty() ? from.parent_path().filename() : from.filename();
+    return dst / name;
+}
+
+bool isBuiltin(const std::string& name) {
+    for (const char* b : Shell::BUILTINS) {
+        if (name == b) return true;
+    }
+    return false;
+}
+}
+
 Shell::Shell(const std::string& exePath) : isRunning(true) {
     SessionManager::init(exePath);
     SessionManager::ensureSessionDirectory();
+    HistoryStore::init(exePath);
+    Completion::startPathIndex();
     multiplexer.init();
-    
-    // Init main pane history
-    multiplexer.getActivePane().session->initHistory(exePath);
 
     if (!fs::exists("cmds")) {
         fs::create_directory("cmds");
@@ -60,25 +179,25 @@ void Shell::log(const std::string& text) {
 void Shell::run() {
     multiplexer.init(); 
     Signal::init();
-
-    HANDLE hIn = GetStdHandle(STD_INPUT_HANDLE);
-    DWORD prevMode;
-    GetConsoleMode(hIn, &prevMode);
-    if (!SetConsoleMode(hIn, ENABLE_EXTENDED_FLAGS | ENABLE_WINDOW_INPUT | ENABLE_MOUSE_INPUT)) {
-        std::cerr << "Error setting console mode" << std::endl;
-    }
+    terminal.enterRawMode();
+    
+    std::vector<TermEvent> events;
     
     while (isRunning) {
         try {
-            // 1. Poll Sessions
+            // 1. Drain Sessions, at most PANE_OUTPUT_BUDGET per pane per
+            // tick so one flooding child cannot starve input or other panes
+            bool flooding = false;
             auto panes = multiplexer.getAllPanes();
             for (auto* pane : panes) {
                 if (pane->session) {
                     bool busy = pane->session->isBusy();
-                    std::string out = pane->session->pollOutput();
+                    std::string out = pane->session->pollOutput(PANE_OUTPUT_BUDGET);
                     if (!out.empty()) pane->write(out);
+                    pane->throttled = out.size() >= PANE_OUTPUT_BUDGET;
+                    if (pane->throttled) flooding = true;
                     
-                    if (pane->waitingForProcess && !busy) {
+                    if (pane->waitingForProcess && !busy && !pane->throttled) {
                          pane->waitingForProcess = false;
                          
                          // Print Prompt
@@ -102,104 +221,25 @@ void Shell::run() {
                 fs::current_path(multiplexer.getActivePane().session->getCwd());
             } catch (...) {}
 
-            // 3. Render
+            // 3. Input Handling: everything pending, in one batch
+            events.clear();
+            terminal.readEvents(events);
+            for (const TermEvent& ev : events) {
+                handleEvent(ev);
+                if (!isRunning) break;
+            }
+            if (!isRunning) break;
+
+            // 4. Render
             multiplexer.render();
             
-            // 4. Input Handling
-            DWORD nAvailable = 0;
-            GetNumberOfConsoleInputEvents(hIn, &nAvailable);
-            
-            if (nAvailable > 0) {
-                INPUT_RECORD ir[128];
-                DWORD nRead;
-                if (ReadConsoleInput(hIn, ir, 128, &nRead) && nRead > 0) {
-                    for (DWORD i = 0; i < nRead; ++i) {
-                        if (ir[i].EventType == KEY_EVENT) {
-                            Pane& p = multiplexer.getActivePane();
-                            bool bKeyDown = ir[i].Event.KeyEvent.bKeyDown;
-                            WORD vk = ir[i].Event.KeyEvent.wVirtualKeyCode;
-                            char c = ir[i].Event.KeyEvent.uChar.AsciiChar;
-                            DWORD dwCtrl = ir[i].Event.KeyEvent.dwControlKeyState;
-                            
-                            bool ctrl = (dwCtrl & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) != 0;
-                            bool shift = (dwCtrl & SHIFT_PRESSED) != 0;
-                            
-                            // Define Prompt Helper
-                            auto printPrompt = [&](Pane& p) {
-                                std::string folder = fs::path(p.session->getCwd()).filename().string();
-                                if (folder.empty()) folder = p.session->getCwd();
-                                std::string prompt = "\n\033[36mMinSh[" + std::to_string(p.id) + "]\033[0m@\033[32m" + folder + "\033[0m: ";
-                                p.write(prompt);
-                                p.currentInput.clear();
-                                p.inputCursor = 0;
-                            };
-
-                            if (bKeyDown && ctrl && shift && vk == 'C') {
-                                // Global Copy
-                                Input::handleClipboardCopy(p);
-                                continue; 
-                            }
-
-                            if (p.session && p.session->isBusy()) {
-                                // Busy State
-                                if (bKeyDown && ctrl && !shift && vk == 'C') {
-                                    // SIGINT (CTRL+C)
-                                    GenerateConsoleCtrlEvent(CTRL_C_EVENT, 0);
-                                    // p.write("^C"); // Optional visual
-                                } else if (bKeyDown) {
-                                    // Forward chars
-                                    if (c != 0) {
-                                        std::string s(1, c);
-                                        p.session->writeInput(s);
-                                        p.write(s); 
-                                    }
-                                }
-                            } else {
-                                // Shell Idle State
-                                if (bKeyDown && ctrl && !shift && vk == 'C') {
-                                     // Cancel Input
-                                     p.write("^C");
-                                     printPrompt(p);
-                                } else {
-                                    // Line Editing
-                                    Interrupts::processKey(p, ir[i].Event.KeyEvent);
-                                    
-                                    // Check Enter
-                                    if (bKeyDown && c == '\r') {
-                                        p.write("\n");
-                                        std::string cmd = p.currentInput;
-                                        p.currentInput.clear();
-                                        p.inputCursor = 0;
-                                        
-                                        if (!cmd.empty()) {
-                                            p.session->addHistory(cmd);
-                                            p.session->resetHistoryIndex();
-                                            parseAndExecute(cmd);
-                                        } else {
-                                            printPrompt(p);
-                                        }
-                                        
-                                        if (!p.waitingForProcess && !cmd.empty()) {
-                                             printPrompt(p);
-                                        }
-                                    }
-                                }
-                            }
-                        } else if (ir[i].EventType == MOUSE_EVENT) {
-                             MOUSE_EVENT_RECORD& mer = ir[i].Event.MouseEvent;
-                             if (mer.dwEventFlags & MOUSE_WHEELED) {
-                                  // High word is delta
-                                  short delta = (short)(mer.dwButtonState >> 16);
-                                  multiplexer.handleMouseWheel(mer.dwMousePosition.X, mer.dwMousePosition.Y, delta);
-                             } else if (mer.dwButtonState == FROM_LEFT_1ST_BUTTON_PRESSED) {
-                                 multiplexer.handleMouse(mer.dwMousePosition.X, mer.dwMousePosition.Y, 1);
-                             }
-                        }
-                    }
-                }
-            } else {
-                Sleep(10); // Prevent CPU burn
+            // 5. Sleep until input arrives, a child writes or exits
+            loop.clear();
+            loop.watch(terminal.inputSource());
+            for (auto* pane : multiplexer.getAllPanes()) {
+                if (pane->session) loop.watch(pane->session->waitSource());
             }
+            loop.wait(flooding ? 0 : -1); // Leftover output is read next tick
         } catch (const std::exception& e) {
             debugLog("CRASH AVOIDED: " + std::string(e.what()));
             logError("Internal Crash Avoided: " + std::string(e.what()));
@@ -210,7 +250,104 @@ void Shell::run() {
     }
     
     multiplexer.exitGuiMode();
-    SetConsoleMode(hIn, prevMode);
+    terminal.restoreMode();
+    Completion::shutdown();
+}
+
+void Shell::handleEvent(const TermEvent& ev) {
+    if (ev.type == TermEvent::KEY) {
+        Pane& p = multiplexer.getActivePane();
+        const KeyEvent& key = ev.key;
+        bool bKeyDown = key.down;
+        int vk = key.key;
+        char c = key.ch;
+        bool ctrl = key.ctrl;
+        bool shift = key.shift;
+        
+        // Define Prompt Helper
+        auto printPrompt = [&](Pane& p) {
+            std::string folder = fs::path(p.session->getCwd()).filename().string();
+            if (folder.empty()) folder = p.session->getCwd();
+            std::string prompt = "\n\033[36mMinSh[" + std::to_string(p.id) + "]\033[0m@\033[32m" + folder + "\033[0m: ";
+            p.write(prompt);
+            p.currentInput.clear();
+            p.inputCursor = 0;
+        };
+
+        if (bKeyDown && ctrl && shift && vk == 'C') {
+            // Global Copy
+            Input::handleClipboardCopy(p);
+            return; 
+        }
+
+        if (p.session && p.session->isBusy()) {
+            // Busy State
+            if (bKeyDown && ctrl && !shift && vk == 'C') {
+                // SIGINT (CTRL+C)
+                p.session->interrupt();
+                // p.write("^C"); // Optional visual
+            } else if (bKeyDown) {
+                // Forward chars (whole escape sequences where we have them)
+                std::string s = !key.seq.empty() ? key.seq : (c != 0 ? std::string(1, c) : std::string());
+                if (!s.empty()) {
+                    p.session->writeInput(s);
+                    if (!p.session->echoesInput()) p.write(s);
+                }
+            }
+        } else {
+            // Shell Idle State
+            if (bKeyDown && ctrl && !shift && vk == 'C') {
+                 // Cancel Input
+                 p.searching = false;
+                 p.hideSuggestion();
+                 p.write("^C");
+                 printPrompt(p);
+            } else if (bKeyDown && vk == KEY_TAB && !p.searching) {
+                std::vector<std::string> matches = Interrupts::completeWord(p);
+                if (!matches.empty()) {
+                    // Ambiguous: list them and start over on a fresh prompt
+                    std::string input = p.currentInput;
+                    int cursor = p.inputCursor;
+                    p.write("\n");
+                    listCompletions(p, matches);
+                    printPrompt(p);
+                    p.write(input);
+                    p.currentInput = input;
+                    p.inputCursor = input.length();
+                    p.moveCursor(cursor - (int)input.length());
+                }
+            } else {
+                // Line Editing
+                Interrupts::processKey(p, key);
+                
+                // Check Enter
+                if (bKeyDown && c == '\r') {
+                    p.write("\n");
+                    std::string cmd = p.currentInput;
+                    p.currentInput.clear();
+                    p.inputCursor = 0;
+                    
+                    if (!cmd.empty()) {
+                        p.session->addHistory(cmd);
+                        p.session->resetHistoryIndex();
+                        parseAndExecute(cmd);
+                    } else {
+                        printPrompt(p);
+                    }
+                    
+                    if (!p.waitingForProcess && !cmd.empty()) {
+                         printPrompt(p);
+                    }
+                }
+            }
+        }
+    } else if (ev.type == TermEvent::MOUSE_WHEEL) {
+        multiplexer.handleMouseWheel(ev.x, ev.y, ev.delta);
+    } else if (ev.type == TermEvent::MOUSE_CLICK) {
+        multiplexer.handleMouse(ev.x, ev.y, 1);
+    } else if (ev.type == TermEvent::RESIZE) {
+        multiplexer.invalidate();
+    }
 }
 
 
@@ -225,6 +362,11 @@ void Shell::parseAndExecute(const std::string& input) {
         auto tokens = Lexer::tokenize(input);
         if (tokens.empty()) return;
 
+        if (Lexer::hasOperators(tokens)) {
+            executePipeline(tokens);
+            return;
+        }
+
         std::vector<std::string> args;
         for (const auto& token : tokens) {
             args.push_back(token.value);
@@ -252,6 +394,14 @@ void Shell::parseAndExecute(const std::string& input) {
             cmdSesh(args);
         } else if (command == "read") {
             cmdRead(args);
+        } else if (command == "hash") {
+            cmdHash(args);
+        } else if (command == "search") {
+            cmdSearch(args);
+        } else if (command == "copy") {
+            cmdCopy(args);
+        } else if (command == "move") {
+            cmdMove(args);
         } else {
             executeExternal(command, args);
         }
@@ -264,46 +414,115 @@ void Shell::parseAndExecute(const std::string& input) {
 
 void Shell::executeExternal(const std::string& cmd, const std::vector<std::string>& args) {
     Pane& p = multiplexer.getActivePane();
-    
-    std::string execCmd = cmd;
-    bool foundInCmds = false;
-    
-    // Check cmds folder
-    fs::path cmdsDir("cmds");
-    std::vector<std::string> extensions = {"", ".exe", ".bat", ".cmd", ".com"};
-    
-    for (const auto& ext : extensions) {
-        fs::path pPath = cmdsDir / (cmd + ext);
-        if (fs::exists(pPath)) {
-            execCmd = pPath.string();
-            foundInCmds = true;
-            break;
-        }
+    if (!p.session) {
+        logError("Minsh: internal error: no session");
+        return;
     }
 
-    // Build command line
-    std::string commandLine = "";
-    if (foundInCmds) { 
-        commandLine = execCmd;
+    // A one-stage pipeline: the arguments go to the program as they are,
+    // never through a shell that would expand or split them again
+    std::string cwd = p.session->getCwd();
+    PipelineStage stage;
+    stage.args = args;
+    // cmds folder first, then PATH, remembered between runs
+    stage.program = cmd.find_first_of("/\\") != std::string::npos
+        ? (fs::path(cwd) / cmd).string()
+        : CommandCache::resolve(cmd, cwd);
+    if (stage.program.empty()) {
+        logError("Minsh: " + cmd + ": command not found");
+        return;
+    }
+
+    if (p.session->execute(std::vector<PipelineStage>{ stage })) {
+        p.waitingForProcess = true;
     } else {
-        commandLine = cmd; 
+#ifdef _WIN32
+         std::string reason = std::to_string(GetLastError());
+#else
+         std::string reason = strerror(errno);
+#endif
+         logError("Minsh: " + cmd + ": command not found or failed to execute (" + reason + ")");
     }
+}
 
-    for (size_t i = 1; i < args.size(); ++i) {
-        commandLine += " \"" + args[i] + "\"";
+// Commands joined by | and/or redirected. The stages are wired to each
+// other and to their files directly; only what the last one writes (and
+// unredirected stderr) reaches the pane.
+void Shell::executePipeline(const std::vector<Token>& tokens) {
+    Pane& p = multiplexer.getActivePane();
+    if (!p.session) {
+        logError("Minsh: internal error: no session");
+        return;
     }
 
-    if (p.session) {
-        if (p.session->execute(commandLine)) {
-            p.waitingForProcess = true;
-        } else {
-             logError("Minsh: " + cmd + ": command not found or failed to execute (" + std::to_string(GetLastError()) + ")");
+    std::vector<PipelineStage> stages;
+    std::string error;
+    if (!Lexer::parsePipeline(tokens, stages, error)) {
+        logError("Minsh: " + error);
+        return;
+    }
+
+    std::string cwd = p.session->getCwd();
+    for (auto& stage : stages) {
+        const std::string& name = stage.args[0];
+        if (isBuiltin(name)) {
+            logError("Minsh: " + name + ": builtins cannot be piped or redirected");
+            return;
         }
+        stage.program = name.find_first_of("/\\") != std::string::npos
+            ? (fs::path(cwd) / name).string()
+            : CommandCache::resolve(name, cwd);
+        if (stage.program.empty()) {
+            logError("Minsh: " + name + ": command not found");
+            return;
+        }
+        for (auto& r : stage.redirects) {
+            if (r.dupOf < 0) r.path = (fs::path(cwd) / r.path).string();
+        }
+    }
+
+    if (p.session->execute(stages)) {
+        p.waitingForProcess = true;
     } else {
-        logError("Minsh: internal error: no session");
+#ifdef _WIN32
+        std::string reason = std::to_string(GetLastError());
+#else
+        std::string reason = strerror(errno);
+#endif
+        logError("Minsh: failed to start pipeline (" + reason + ")");
     }
-    
-    // Force poll immediately? No, loop handles it.
+}
+
+// Candidates in columns, by their last path component.
+void Shell::listCompletions(Pane& p, const std::vector<std::string>& matches) {
+    std::vector<std::string> names;
+    size_t width = 0;
+    for (size_t i = 0; i < matches.size() && i < MAX_LISTED_COMPLETIONS; ++i) {
+        std::string name = matches[i];
+        if (!name.empty() && name[0] == '"') name.erase(0, 1);
+        size_t slash = name.find_last_of("/\\", name.size() >= 2 ? name.size() - 2 : std::string::npos);
+        if (slash != std::string::npos) name.erase(0, slash + 1);
+        width = std::max(width, name.size() + 2);
+        names.push_back(name);
+    }
+
+    size_t columns = std::max<size_t>(1, p.grid->sx / width);
+    size_t rows = (names.size() + columns - 1) / columns;
+    std::string out;
+    for (size_t r = 0; r < rows; ++r) {
+        for (size_t c = 0; c < columns; ++c) {
+            size_t i = c * rows + r;
+            if (i >= names.size()) break;
+            out += names[i];
+            if (c + 1 < columns && i + rows < names.size()) out.append(width - names[i].size(), ' ');
+        }
+        out += "\n";
+    }
+    if (matches.size() > names.size()) {
+        out += "... and " + std::to_string(matches.size() - names.size()) + " more\n";
+    }
+    out.pop_back(); // The prompt starts on a new line
+    p.write(out);
 }
 
 void Shell::cmdExit() {
@@ -317,9 +536,15 @@ void Shell::cmdHelp() {
     logLn("  cwd                        - current directory");
     logLn("  make [-f/-d] <name>        - creates a file or directory");
     logLn("  remove [-f/-d] <name>      - removes a file or directory");
+    logLn("  copy [-d] <src> <dst>      - copies a file (-d for a directory tree)");
+    logLn("  move <src> <dst>           - moves or renames a file or directory");
     logLn("  list [-all/-hidden] <path> - lists files and directories");
+    logLn("    -long                    - with mode, size and modification time");
     logLn("  read <file> [flags]        - reads file content");
-    logLn("    -h(\"word\")              - highlights word in red");
+    logLn("    -h(\"word\")              - highlights word in red (repeatable)");
+    logLn("    -r(regex)                - highlights regex matches in red");
+    logLn("                               (| < > stay in the pattern; quote spaces)");
+    logLn("    -i                       - highlights ignoring case");
     logLn("    -f(n)                    - reads first n lines");
     logLn("    -l(n)                    - reads last n lines");
     logLn("  sesh <subcommand>          - session management:");
@@ -327,12 +552,86 @@ void Shell::cmdHelp() {
     logLn("    load <name>              - loads a session");
     logLn("    update <name>            - updates saved session");
     logLn("    remove <name>            - removes a session");
+    logLn("    save-workspace <name>    - saves the layout and every pane");
+    logLn("    load-workspace <name>    - restores a saved workspace");
     logLn("    list [-b]                - lists sessions (-b for background only)");
     logLn("    add                      - splits screen with new session");
     logLn("    switch <number>          - switches focus to session N");
+    logLn("    scrollback [lines]       - shows or sets the active pane's scrollback");
     logLn("    detach                   - moves active session to background");
     logLn("    retach <index>           - brings background session to foreground");
+    logLn("  hash [-r]                  - lists remembered command paths (-r forgets them)");
+    logLn("  search <pattern> [path]    - finds names containing pattern under path");
+    logLn("    -c                       - also searches inside files");
+    logLn("    -i                       - ignores case");
+    logLn("    -hidden                  - includes names starting with '.'");
     logLn("  exit                       - exits the shell");
+    logLn("Keys:");
+    logLn("  Up/Down                    - previous/next command");
+    logLn("  Right/End                  - takes the grey suggestion from history");
+    logLn("  Tab                        - completes commands, sesh subcommands and paths");
+    logLn("  Ctrl+R                     - searches history (again for older matches,");
+    logLn("                               Enter runs, Esc keeps the line, Ctrl+G cancels)");
+}
+
+void Shell::cmdHash(const std::vector<std::string>& args) {
+    if (args.size() > 1 && args[1] == "-r") {
+        CommandCache::clear();
+        return;
+    }
+    if (args.size() > 1) {
+        logError("Minsh: hash: usage: hash [-r]");
+        return;
+    }
+
+    auto entries = CommandCache::entries();
+    if (entries.empty()) {
+        logLn("hash: no commands remembered");
+        return;
+    }
+    std::sort(entries.begin(), entries.end());
+    for (const auto& e : entries) logLn(e.first + "\t" + e.second);
+}
+
+void Shell::cmdSearch(const std::vector<std::string>& args) {
+    Pane& p = multiplexer.getActivePane();
+    Search::Options options;
+    std::string path = ".";
+    int operands = 0;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "-c") {
+            options.contents = true;
+        } else if (args[i] == "-i") {
+            options.ignoreCase = true;
+        } else if (args[i] == "-all" || args[i] == "-hidden") {
+            options.hidden = true;
+        } else if (operands == 0) {
+            options.pattern = args[i];
+            operands++;
+        } else if (operands == 1) {
+            path = args[i];
+            operands++;
+        } else {
+            operands++;
+        }
+    }
+    if (options.pattern.empty() || operands > 2) {
+        logError("Minsh: search: usage: search [-c] [-i] [-hidden] <pattern> [path]");
+        return;
+    }
+
+    std::error_code ec;
+    fs::path root = inCwd(p, path);
+    if (!fs::is_directory(root, ec)) {
+        logError("Minsh: search: " + path + ": directory not found");
+        return;
+    }
+    options.root = root.string();
+
+    // Runs off the UI thread; results stream in, Ctrl+C stops it
+    if (p.session->run([options](Job& job) { Search::run(job, options); })) {
+        p.waitingForProcess = true;
+    }
 }
 
 void Shell::cmdSay(const std::vector<std::string>& args) {
@@ -439,7 +738,12 @@ void Shell::cmdRemove(const std::vector<std::string>& args) {
              if (!fs::is_directory(name)) {
                   logError("Minsh: " + name + ": is not a directory");
              } else {
-                 fs::remove_all(name);
+                 // Runs off the UI thread with a progress line; Ctrl+C stops it
+                 Pane& p = multiplexer.getActivePane();
+                 std::string path = inCwd(p, name).string();
+                 if (p.session->run([path](Job& job) { FileOps::remove(job, path); })) {
+                     p.waitingForProcess = true;
+                 }
              }
         } else {
              logError("Minsh: remove: invalid arguments");
@@ -449,39 +753,169 @@ void Shell::cmdRemove(const std::vector<std::string>& args) {
     }
 }
 
+void Shell::cmdCopy(const std::vector<std::string>& args) {
+    Pane& p = multiplexer.getActivePane();
+    bool tree = args.size() == 4 && args[1] == "-d";
+    if (args.size() != (tree ? 4u : 3u)) {
+        logError("Minsh: copy: usage: copy [-d] <src> <dst>");
+        return;
+    }
+    const std::string& name = args[tree ? 2 : 1];
+    fs::path from = inCwd(p, name);
+    std::error_code ec;
+    if (!fs::exists(from, ec)) {
+        logError("Minsh: " + name + (tree ? ": directory not found" : ": file not found"));
+        return;
+    }
+    if (fs::is_directory(from, ec) != tree) {
+        logError("Minsh: " + name + (tree ? ": is not a directory" : ": is a directory (use copy -d)"));
+        return;
+    }
+    fs::path to = destinationFor(from, inCwd(p, args[tree ? 3 : 2]));
+    if (tree) {
+        // Would never end: every pass copies the copy again
+        fs::path rel = fs::weakly_canonical(to, ec).lexically_relative(fs::weakly_canonical(from, ec));
+        if (!rel.empty() && *rel.begin() != "..") {
+            logError("Minsh: copy: cannot copy " + name + " into itself");
+            return;
+        }
+    } else if (fs::equivalent(from, to, ec)) {
+        logError("Minsh: copy: " + name + " and its destination are the same file");
+        return;
+    }
+
+    std::string src = from.string();
+    std::string dst = to.string();
+    if (p.session->run([src, dst, tree](Job& job) { FileOps::copy(job, src, dst, tree); })) {
+        p.waitingForProcess = true;
+    }
+}
+
+void Shell::cmdMove(const std::vector<std::string>& args) {
+    Pane& p = multiplexer.getActivePane();
+    if (args.size() != 3) {
+        logError("Minsh: move: usage: move <src> <dst>");
+        return;
+    }
+    fs::path from = inCwd(p, args[1]);
+    std::error_code ec;
+    if (!fs::exists(fs::symlink_status(from, ec))) {
+        logError("Minsh: " + args[1] + ": file not found");
+        return;
+    }
+    fs::path to = destinationFor(from, inCwd(p, args[2]));
+
+    // Within one file system this is only a rename
+    fs::rename(from, to, ec);
+    if (!ec) return;
+    if (ec != std::errc::cross_device_link) {
+        logError("Minsh: move: " + args[1] + ": " + ec.message());
+        return;
+    }
+
+    std::string src = from.string();
+    std::string dst = to.string();
+    if (p.session->run([src, dst](Job& job) { FileOps::moveByCopy(job, src, dst); })) {
+        p.waitingForProcess = true;
+    }
+}
+
 void Shell::cmdList(const std::vector<std::string>& args) {
     bool showHidden = false;
+    bool longFormat = false;
     std::string pathString = ".";
     
     for (size_t i = 1; i < args.size(); ++i) {
         if (args[i] == "-all" || args[i] == "-hidden") {
             showHidden = true;
+        } else if (args[i] == "-long") {
+            longFormat = true;
         } else {
             pathString = args[i];
         }
     }
 
-    try {
-        if (!fs::exists(pathString)) {
-             logError("Minsh: " + pathString + ": directory not found");
-             return;
+    DirectoryReader dir;
+    std::string error;
+    if (!dir.read(pathString, showHidden, error)) {
+        if (error == "directory not found") logError("Minsh: " + pathString + ": directory not found");
+        else logError("Minsh: list: " + error);
+        return;
+    }
+    // Colours need each entry's type; most file systems give it with the
+    // name, so only -long stats everything.
+    dir.statAll(!longFormat);
+    dir.sort();
+
+    const auto& entries = dir.entries();
+    if (entries.empty()) return;
+    Pane& p = multiplexer.getActivePane();
+    std::string out;
+    out.reserve(entries.size() * (longFormat ? 64 : 24));
+
+    if (longFormat) {
+        size_t sizeWidth = 1;
+        for (const auto& e : entries) sizeWidth = std::max(sizeWidth, std::to_string(e.size).size());
+        for (const auto& e : entries) {
+            out += modeString(e);
+            out += ' ';
+            std::string size = std::to_string(e.size);
+            out.append(sizeWidth - size.size(), ' ');
+            out += size;
+            out += ' ';
+            out += timeString(e.mtime);
+            out += ' ';
+            appendEntryName(out, dir, e);
+            out += '\n';
         }
-        
-        for (const auto& entry : fs::directory_iterator(pathString)) {
-            std::string filename = entry.path().filename().string();
-            if (!showHidden && filename[0] == '.') {
-                continue;
+    } else {
+        // Down the columns like ls: the most columns whose widest names
+        // (plus two spaces between) still fit the pane
+        std::vector<size_t> widths;
+        widths.reserve(entries.size());
+        size_t narrowest = SIZE_MAX;
+        for (const auto& e : entries) {
+            widths.push_back(displayWidth(dir.name(e)) + (e.type == DirectoryReader::DIR ? 1 : 0));
+            narrowest = std::min(narrowest, widths.back());
+        }
+        size_t screen = (size_t)std::max(1, p.grid->sx - 1);
+        size_t n = entries.size();
+        size_t columns = 1;
+        size_t rows = n;
+        std::vector<size_t> columnWidths(1, 0);
+        for (size_t tryColumns = std::min(n, screen / (narrowest + 2) + 1); tryColumns > 1; --tryColumns) {
+            size_t r = (n + tryColumns - 1) / tryColumns;
+            size_t c = (n + r - 1) / r; // No empty trailing columns
+            std::vector<size_t> w(c, 0);
+            size_t total = 0;
+            for (size_t k = 0; k < c && total <= screen; ++k) {
+                for (size_t i = k * r; i < std::min(n, (k + 1) * r); ++i) w[k] = std::max(w[k], widths[i]);
+                total += w[k] + (k + 1 < c ? 2 : 0);
+            }
+            if (total <= screen) {
+                columns = c;
+                rows = r;
+                columnWidths.swap(w);
+                break;
             }
-            logLn(filename);
         }
-    } catch (const fs::filesystem_error& e) {
-        logError("Minsh: list: permission denied");
+
+        for (size_t r = 0; r < rows; ++r) {
+            for (size_t c = 0; c < columns; ++c) {
+                size_t i = c * rows + r;
+                if (i >= entries.size()) break;
+                appendEntryName(out, dir, entries[i]);
+                if (c + 1 < columns && i + rows < entries.size()) out.append(columnWidths[c] + 2 - widths[i], ' ');
+            }
+            out += '\n';
+        }
     }
+    log(out);
 }
 
 void Shell::cmdSesh(const std::vector<std::string>& args) {
     if (args.size() < 2) {
-        logError("Minsh: sesh: invalid arguments. Use save, load, list, add, switch, detach, retach.");
+        logError("Minsh: sesh: invalid arguments. Use save, load, save-workspace, load-workspace, list, add, switch, detach, retach.");
         return;
     }
 
@@ -493,24 +927,7 @@ void Shell::cmdSesh(const std::vector<std::string>& args) {
             return;
         }
         std::string name = args[2];
-        // Join all history lines - Hard to extract from Grid perfectly without iterating full grid
-    } else if (subcmd == "save") {
-        if (args.size() < 3) {
-            logLn("Minsh: sesh save: missing session name");
-            return;
-        }
-        std::string name = args[2];
-        std::ostringstream oss;
-        Pane& p = multiplexer.getActivePane();
-        for (const auto& line : p.grid->lines) {
-             std::string lineStr;
-             for (const auto& c : line->cells) if (c.data != 0) lineStr += (char)c.data;
-             while (!lineStr.empty() && lineStr.back() == ' ') lineStr.pop_back();
-             if(!lineStr.empty()) oss << lineStr << "\n";
-        }
-        std::string cwd = p.cwd;
-        
-        if (SessionManager::saveSession(name, oss.str(), cwd)) {
+        if (SessionManager::saveSession(name, multiplexer.getActivePane())) {
             logLn("Session '" + name + "' saved.");
         } else {
             logError("Minsh: sesh save: failed to save session");
@@ -521,19 +938,37 @@ void Shell::cmdSesh(const std::vector<std::string>& args) {
             logError("Minsh: sesh load: missing session name");
             return;
         }
-        std::string name = args[2];
-        SessionData data = SessionManager::loadSession(name);
-        if (data.content.empty() && data.cwd.empty()) {
-            logError("Minsh: sesh load: session not found or empty");
+        std::string error;
+        if (!SessionManager::loadSession(args[2], multiplexer.getActivePane(), error)) {
+            logError("Minsh: sesh load: " + error);
+        }
+
+    } else if (subcmd == "save-workspace") {
+        if (args.size() < 3) {
+            logError("Minsh: sesh save-workspace: missing workspace name");
+            return;
+        }
+        if (SessionManager::saveWorkspace(args[2], multiplexer)) {
+            logLn("Workspace '" + args[2] + "' saved.");
         } else {
-            Pane& p = multiplexer.getActivePane();
-            p.cwd = data.cwd;
-            p.grid = std::make_unique<Grid>(p.grid->sx, p.grid->sy); // Clear
-            p.write(data.content);
-            try {
-                fs::current_path(p.cwd);
-            } catch (...) {}
+            logError("Minsh: sesh save-workspace: failed to save workspace");
+        }
+
+    } else if (subcmd == "load-workspace") {
+        if (args.size() < 3) {
+            logError("Minsh: sesh load-workspace: missing workspace name");
+            return;
+        }
+        std::string error;
+        if (!SessionManager::loadWorkspace(args[2], multiplexer, error)) {
+            logError("Minsh: sesh load-workspace: " + error);
+            return;
         }
+        // The pane this ran in is gone; the restored active pane gets the
+        // next prompt
+        Pane& restored = multiplexer.getActivePane();
+        restored.loadPendingSnapshot();
+        restored.waitingForProcess = true;
 
     } else if (subcmd == "add") {
         multiplexer.addPane();
@@ -551,6 +986,22 @@ void Shell::cmdSesh(const std::vector<std::string>& args) {
         } catch (...) {
             logError("Minsh: sesh switch: invalid number");
         }
+    } else if (subcmd == "scrollback") {
+        Pane& p = multiplexer.getActivePane();
+        if (args.size() < 3) {
+            logLn("Scrollback: " + std::to_string(p.grid->hlimit) + " lines");
+            return;
+        }
+        try {
+            int lines = std::stoi(args[2]);
+            if (lines < 0) {
+                logError("Minsh: sesh scrollback: invalid number");
+                return;
+            }
+            p.setHistoryLimit(lines);
+        } catch (...) {
+            logError("Minsh: sesh scrollback: invalid number");
+        }
     } else if (subcmd == "detach") {
         if (!multiplexer.detachActivePane()) {
             logError("Minsh: sesh detach: cannot detach the last pane");
@@ -587,16 +1038,8 @@ void Shell::cmdSesh(const std::vector<std::string>& args) {
             return;
         }
         std::string name = args[2];
-        std::ostringstream oss;
-        Pane& p = multiplexer.getActivePane();
-        for (const auto& line : p.grid->lines) {
-             std::string lineStr;
-             for (const auto& c : line->cells) if (c.data != 0) lineStr += (char)c.data;
-             while (!lineStr.empty() && lineStr.back() == ' ') lineStr.pop_back();
-             if(!lineStr.empty()) oss << lineStr << "\n";
-        }
         // Save overwrites.
-        if (SessionManager::saveSession(name, oss.str(), p.cwd)) {
+        if (SessionManager::saveSession(name, multiplexer.getActivePane())) {
             logLn("Session '" + name + "' updated.");
         } else {
             logError("Minsh: sesh update: failed to update session");
@@ -616,6 +1059,13 @@ void Shell::cmdSesh(const std::vector<std::string>& args) {
                     logLn("  " + s);
                 }
             }
+            std::vector<std::string> workspaces = SessionManager::listWorkspaces();
+            if (!workspaces.empty()) {
+                logLn("Saved Workspaces:");
+                for (const auto& w : workspaces) {
+                    logLn("  " + w);
+                }
+            }
         }
         
         // List background
@@ -636,7 +1086,7 @@ void Shell::cmdSesh(const std::vector<std::string>& args) {
             }
         }
         
-        if (!onlyBackground && SessionManager::listSessions().empty() && bg.empty()) {
+        if (!onlyBackground && SessionManager::listSessions().empty() && SessionManager::listWorkspaces().empty() && bg.empty()) {
             logLn("No sessions found.");
         } else if (onlyBackground && bg.empty()) {
             logLn("No background sessions found.");
@@ -653,21 +1103,29 @@ void Shell::cmdRead(const std::vector<std::string>& args) {
     }
 
     std::string filename;
-    std::string highlightWord;
+    Matcher matcher;
     int headCount = -1;
     int tailCount = -1;
 
     // Parse Args
     for (size_t i = 1; i < args.size(); ++i) {
         std::string arg = args[i];
-        if (arg.rfind("-h(", 0) == 0 && arg.back() == ')') {
-            // Highlight: -h("word") or -h(word)
+        // -h("two words") reaches us as "-h(", "two words", ")"
+        if ((arg == "-h(" || arg == "-r(") && i + 2 < args.size() && args[i + 2] == ")") {
+            arg += args[i + 1] + ")";
+            i += 2;
+        }
+        if ((arg.rfind("-h(", 0) == 0 || arg.rfind("-r(", 0) == 0) && arg.size() > 3 && arg.back() == ')') {
+            // Highlight: -h("word") or -h(word) for text, -r(regex) for a pattern
             std::string val = arg.substr(3, arg.length() - 4);
             // Strip quotes if present
             if (val.size() >= 2 && ((val.front() == '"' && val.back() == '"') || (val.front() == '\'' && val.back() == '\''))) {
                 val = val.substr(1, val.length() - 2);
             }
-            highlightWord = val;
+            if (arg[1] == 'h') matcher.addLiteral(val);
+            else matcher.addRegex(val);
+        } else if (arg == "-i") {
+            matcher.setIgnoreCase(true);
         } else if (arg.rfind("-l(", 0) == 0 && arg.back() == ')') {
             // Tail: -l(10)
             try {
@@ -687,58 +1145,61 @@ void Shell::cmdRead(const std::vector<std::string>& args) {
         logError("Minsh: read: missing filename");
         return; 
     }
+
+    std::string error;
+    if (!matcher.compile(error)) {
+        logError("Minsh: read: " + error);
+        return;
+    }
     
     if (!fs::exists(filename)) {
         logError("Minsh: read: " + filename + ": no such file or directory");
         return;
     }
     
-    std::ifstream file(filename);
-    if (!file) {
+    MappedFile file(filename);
+    if (!file.ok()) {
         logError("Minsh: read: permission denied");
         return;
     }
-    
-    std::vector<std::string> lines;
-    std::string line;
-    while (std::getline(file, line)) {
-        lines.push_back(line);
-    }
-    
-    // Apply Head (-f)
-    if (headCount != -1) {
-        if (headCount < (int)lines.size()) {
-            lines.resize(headCount);
-        }
-    }
-    
-    // Apply Tail (-l)
-    if (tailCount != -1) {
-        if (tailCount < (int)lines.size()) {
-             std::vector<std::string> newLines;
-             for (size_t i = lines.size() - tailCount; i < lines.size(); ++i) {
-                 newLines.push_back(lines[i]);
-             }
-             lines = newLines;
-        }
-    }
-    
-    // Output with Highlight
-    for (const auto& l : lines) {
-        if (!highlightWord.empty()) {
-            // Find and replace all occurrences
-            std::string printLine = "";
-            size_t pos = 0;
-            size_t found;
-            while ((found = l.find(highlightWord, pos)) != std::string::npos) {
-                printLine += l.substr(pos, found - pos);
-                printLine += "\033[31m" + highlightWord + "\033[0m";
-                pos = found + highlightWord.length();
-            }
-            printLine += l.substr(pos);
-            logLn(printLine);
-        } else {
-            logLn(l);
+
+    // Only the selected part of the file is ever touched: -f stops after
+    // its lines, -l scans back from the end (within -f's part, if given).
+    const char* data = file.data();
+    size_t begin = 0;
+    size_t end = file.size();
+    if (headCount != -1) end = afterLines(data, end, headCount);
+    if (tailCount != -1) begin = lastLines(data, end, tailCount);
+
+    // The file goes out a chunk at a time, with colour codes spliced in
+    // around each match; lines are never rebuilt.
+    std::string chunk;
+    size_t copied = begin;   // Everything before this is in chunk or printed
+    size_t released = begin;
+    auto flush = [&]() {
+        log(chunk);
+        chunk.clear();
+        file.release(released, copied - released);
+        released = copied;
+    };
+    auto copyTo = [&](size_t to) {
+        while (copied < to) {
+            size_t n = std::min(READ_CHUNK - chunk.size(), to - copied);
+            chunk.append(data + copied, n);
+            copied += n;
+            if (chunk.size() >= READ_CHUNK) flush();
         }
-    }
+    };
+
+    matcher.scan(data + begin, end - begin, [&](size_t from, size_t to) {
+        copyTo(begin + from);
+        chunk += "\033[31m";
+        chunk.append(data + begin + from, to - from);
+        chunk += "\033[0m";
+        copied = begin + to;
+        if (chunk.size() >= READ_CHUNK) flush();
+    });
+    copyTo(end);
+    if (end > begin && data[end - 1] != '\n') chunk += '\n';
+    if (!chunk.empty()) flush();
 }
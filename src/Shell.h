@@ -10,21 +10,30 @@
 #include <sstream>
 #include "Multiplex.hpp"
 #include "Lexer.hpp"
+#include "Terminal.hpp"
+#include "EventLoop.hpp"
 
 class Shell {
 public:
     Shell(const std::string& exePath);
     void run();
 
+    // Names parseAndExecute handles itself; completion offers them too
+    static const char* const BUILTINS[];
+    static const size_t BUILTIN_COUNT;
+
 private:
     bool isRunning;
 
     void printPrompt();
+    void handleEvent(const TermEvent& ev);
     void parseAndExecute(const std::string& input);
+    void listCompletions(Pane& p, const std::vector<std::string>& matches);
     // std::vector<std::string> splitInput(const std::string& input); // Replaced by Lexer
 
     // Commands
     void executeExternal(const std::string& cmd, const std::vector<std::string>& args);
+    void executePipeline(const std::vector<Token>& tokens);
 
     // Commands
     void cmdHelp();
@@ -37,6 +46,10 @@ private:
     void cmdList(const std::vector<std::string>& args);
     void cmdSesh(const std::vector<std::string>& args);
     void cmdRead(const std::vector<std::string>& args);
+    void cmdHash(const std::vector<std::string>& args);
+    void cmdSearch(const std::vector<std::string>& args);
+    void cmdCopy(const std::vector<std::string>& args);
+    void cmdMove(const std::vector<std::string>& args);
 
     // Logging helper
     void log(const std::string& text);
@@ -44,6 +57,8 @@ private:
     void logError(const std::string& text);
     
     Multiplexer multiplexer;
+    Terminal terminal;
+    EventLoop loop;
 };
 
 #endif // SHELL_H
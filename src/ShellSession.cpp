@@ -2,14 +2,54 @@
 #include <iostream>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <filesystem>
 #include "Utils.h" 
+#include "HistoryStore.hpp"
+#include "HistorySearch.hpp"
+#include "HistorySuggest.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#endif
 
 namespace fs = std::filesystem;
 
+#ifdef _WIN32
+struct ShellSession::OutputPipe {
+    HANDLE hRead;
+    CRITICAL_SECTION lock;
+    std::string data;
+    HANDLE hDrained; // Set whenever data is below MAX_BUFFERED
+
+    // The reader stops pulling from the pipe at this much unconsumed
+    // output, so a flooding child blocks on its own writes.
+    static const size_t MAX_BUFFERED = 256 * 1024;
+
+    explicit OutputPipe(HANDLE h) : hRead(h) {
+        InitializeCriticalSection(&lock);
+        hDrained = CreateEvent(NULL, TRUE, TRUE, NULL);
+    }
+    ~OutputPipe() {
+        CloseHandle(hRead);
+        CloseHandle(hDrained);
+        DeleteCriticalSection(&lock);
+    }
+};
+
 ShellSession::ShellSession() 
-    : hProcess(NULL), hThread(NULL), 
+    : hProcess(NULL), hThread(NULL), hReader(NULL),
       hChildOutRead(NULL), hChildOutWrite(NULL), 
       hChildErrWrite(NULL), hChildInRead(NULL), hChildInWrite(NULL) 
 {
@@ -22,31 +62,76 @@ ShellSession::ShellSession()
 ShellSession::~ShellSession() {
     cleanupProcess();
     closePipes();
-    saveHistory(); // Save on exit
+    // A reader still blocked on the pipe owns its share of the buffer and
+    // exits on its own once the last writer goes away.
+    if (output) SetEvent(output->hDrained);
+    if (hReader) { CloseHandle(hReader); hReader = NULL; }
+}
+#else
+namespace {
+// Wakes the event loop when a child exits without closing the pty first
+// (e.g. a background grandchild still holds it).
+void onChildExit(int) {
+    EventLoop::notify();
 }
 
-void ShellSession::initHistory(const std::string& exePath) {
-    fs::path binPath(exePath);
-    historyFilePath = (binPath.parent_path() / "history.min").string();
-    
-    std::ifstream infile(historyFilePath);
-    if (infile) {
-        std::string line;
-        while (std::getline(infile, line)) {
-            if (!line.empty()) history.push_back(line);
+// Children of closed sessions that were still running when hung up on.
+// They are reaped as they exit (the SIGCHLD wakeup brings the loop round
+// to isBusy), and killed if they outlive the grace period.
+struct Orphan {
+    pid_t pid;
+    std::chrono::steady_clock::time_point hungUp;
+    bool killed;
+};
+std::vector<Orphan> orphans;
+const auto ORPHAN_GRACE = std::chrono::seconds(2);
+
+void reapOrphans() {
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < orphans.size();) {
+        Orphan& o = orphans[i];
+        if (waitpid(o.pid, NULL, WNOHANG) != 0) { // Reaped, or gone already
+            orphans[i] = orphans.back();
+            orphans.pop_back();
+            continue;
         }
+        if (!o.killed && now - o.hungUp >= ORPHAN_GRACE) {
+            kill(-o.pid, SIGKILL);
+            o.killed = true;
+        }
+        ++i;
+    }
+}
+}
+
+ShellSession::ShellSession() {
+    char buffer[4096];
+    if (getcwd(buffer, sizeof(buffer))) {
+        currentDirectory = std::string(buffer);
+    }
+
+    static bool handlerInstalled = false;
+    if (!handlerInstalled) {
+        struct sigaction sa = {};
+        sa.sa_handler = onChildExit;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+        sigaction(SIGCHLD, &sa, NULL);
+        handlerInstalled = true;
     }
 }
 
-void ShellSession::saveHistory() {
-    if (historyFilePath.empty()) return;
-    std::ofstream outfile(historyFilePath);
-    if (outfile) {
-        for (const auto& cmd : history) {
-            outfile << cmd << "\n";
+ShellSession::~ShellSession() {
+    if (pid > 0) {
+        kill(-pid, SIGHUP);
+        if (waitpid(pid, NULL, WNOHANG) == 0) {
+            orphans.push_back({ pid, std::chrono::steady_clock::now(), false });
         }
     }
+    closeMaster();
+    reapOrphans();
 }
+#endif
 
 void ShellSession::setCwd(const std::string& path) {
     currentDirectory = path;
@@ -56,7 +141,10 @@ std::string ShellSession::getCwd() const {
     return currentDirectory;
 }
 
+#ifdef _WIN32
 void ShellSession::createPipes() {
+    closePipes(); // Handles left over from the previous command
+
     SECURITY_ATTRIBUTES saAttr;
     saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
     saAttr.bInheritHandle = TRUE;
@@ -98,56 +186,155 @@ void ShellSession::cleanupProcess() {
     }
 }
 
-bool ShellSession::execute(const std::string& cmd) {
-    if (isBusy()) return false;
+namespace {
+
+HANDLE openRedirect(const Redirect& r) {
+    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+    if (r.fd == 0) {
+        return CreateFileA(r.path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+    return CreateFileA(r.path.c_str(), r.append ? FILE_APPEND_DATA : GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa,
+                       r.append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+// Appends arg so that CommandLineToArgvW (and the C runtime) read it back
+// unchanged: quoted only when it has to be, backslashes doubled where they
+// come before a quote, embedded quotes escaped.
+void appendArgument(std::string& line, const std::string& arg) {
+    if (!arg.empty() && arg.find_first_of(" \t\n\v\"") == std::string::npos) {
+        line += arg;
+        return;
+    }
+    line += '"';
+    for (size_t i = 0;; ++i) {
+        size_t backslashes = 0;
+        while (i < arg.size() && arg[i] == '\\') {
+            backslashes++;
+            i++;
+        }
+        if (i == arg.size()) {
+            line.append(backslashes * 2, '\\'); // Before the closing quote
+            break;
+        }
+        if (arg[i] == '"') {
+            line.append(backslashes * 2 + 1, '\\');
+        } else {
+            line.append(backslashes, '\\');
+        }
+        line += arg[i];
+    }
+    line += '"';
+}
+
+// The program is quoted when its path has a space (it cannot hold quotes,
+// and backslashes in it are literal); the arguments as they need.
+std::string commandLine(const PipelineStage& stage) {
+    bool spaced = stage.program.find_first_of(" \t") != std::string::npos;
+    std::string line = spaced ? "\"" + stage.program + "\"" : stage.program;
+    for (size_t i = 1; i < stage.args.size(); ++i) {
+        line += ' ';
+        appendArgument(line, stage.args[i]);
+    }
+    return line;
+}
+
+}
+
+// Stages are connected by pipes created non-inheritable; each end is made
+// inheritable only while the stage that uses it is created, so no other
+// stage holds a write end open and EOF arrives when it should. The last
+// stage is the one the session waits for. If a later stage cannot start,
+// the ones already running are terminated.
+bool ShellSession::execute(const std::vector<PipelineStage>& stages) {
+    if (isBusy() || stages.empty()) return false;
 
     createPipes();
 
-    std::string cmdLine = cmd; 
-    
-    PROCESS_INFORMATION piProcInfo;
-    STARTUPINFOA siStartInfo;
-    BOOL bSuccess = FALSE;
-
-    ZeroMemory(&piProcInfo, sizeof(PROCESS_INFORMATION));
-
-    ZeroMemory(&siStartInfo, sizeof(STARTUPINFO));
-    siStartInfo.cb = sizeof(STARTUPINFO);
-    siStartInfo.hStdError = hChildOutWrite;
-    siStartInfo.hStdOutput = hChildOutWrite;
-    siStartInfo.hStdInput = hChildInRead;
-    siStartInfo.dwFlags |= STARTF_USESTDHANDLES;
-
-    // Create the child process.
-    bSuccess = CreateProcessA(NULL,
-        const_cast<char*>(cmdLine.c_str()),     // command line
-        NULL,          // process security attributes
-        NULL,          // primary thread security attributes
-        TRUE,          // handles are inherited
-        0,             // creation flags
-        NULL,          // use parent's environment
-        currentDirectory.c_str(), // use session's CWD
-        &siStartInfo,  // STARTUPINFO
-        &piProcInfo);  // PROCESS_INFORMATION
-
-    // Close the write end of the output pipe in the parent, 
-    // otherwise ReadFile will block forever waiting for EOF.
-    // Also close read end of input pipe.
+    HANDLE prevRead = hChildInRead;
+    std::vector<HANDLE> started; // Earlier stages, until all are running
+    bool ok = true;
+    for (size_t k = 0; k < stages.size() && ok; ++k) {
+        bool last = k + 1 == stages.size();
+        HANDLE pipeRead = NULL;
+        HANDLE pipeWrite = NULL;
+        if (!last) {
+            SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, FALSE };
+            ok = CreatePipe(&pipeRead, &pipeWrite, &sa, 0) != 0;
+        }
+
+        HANDLE stdHandles[3] = { prevRead, last ? hChildOutWrite : pipeWrite, hChildOutWrite };
+        std::vector<HANDLE> files;
+        for (const Redirect& r : stages[k].redirects) {
+            if (!ok) break;
+            if (r.dupOf >= 0) {
+                stdHandles[r.fd] = stdHandles[r.dupOf];
+                continue;
+            }
+            HANDLE h = openRedirect(r);
+            if (h == INVALID_HANDLE_VALUE) {
+                ok = false;
+                break;
+            }
+            files.push_back(h);
+            stdHandles[r.fd] = h;
+        }
+
+        if (ok) {
+            for (HANDLE h : stdHandles) SetHandleInformation(h, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+
+            STARTUPINFOA si;
+            ZeroMemory(&si, sizeof(si));
+            si.cb = sizeof(si);
+            si.hStdInput = stdHandles[0];
+            si.hStdOutput = stdHandles[1];
+            si.hStdError = stdHandles[2];
+            si.dwFlags |= STARTF_USESTDHANDLES;
+            PROCESS_INFORMATION pi;
+            ZeroMemory(&pi, sizeof(pi));
+
+            std::string cmdLine = commandLine(stages[k]);
+            ok = CreateProcessA(NULL, const_cast<char*>(cmdLine.c_str()), NULL, NULL, TRUE, 0, NULL,
+                                currentDirectory.c_str(), &si, &pi) != 0;
+            if (ok && last) {
+                hProcess = pi.hProcess;
+                hThread = pi.hThread;
+            } else if (ok) {
+                started.push_back(pi.hProcess);
+                CloseHandle(pi.hThread);
+            }
+        }
+
+        for (HANDLE h : files) CloseHandle(h);
+        if (pipeWrite) CloseHandle(pipeWrite);
+        if (prevRead != hChildInRead) CloseHandle(prevRead);
+        prevRead = pipeRead;
+    }
+    if (prevRead && prevRead != hChildInRead) CloseHandle(prevRead);
+    for (HANDLE h : started) {
+        if (!ok) TerminateProcess(h, 1);
+        CloseHandle(h);
+    }
+
+    // Only the children keep these ends; ReadFile sees EOF once they exit
     if (hChildOutWrite) { CloseHandle(hChildOutWrite); hChildOutWrite = NULL; }
     if (hChildInRead) { CloseHandle(hChildInRead); hChildInRead = NULL; }
 
-    if (bSuccess) {
-        hProcess = piProcInfo.hProcess;
-        hThread = piProcInfo.hThread;
-        return true;
-    } else {
-        // Failed
+    if (!ok || !hProcess) {
+        cleanupProcess();
         closePipes();
         return false;
     }
+
+    if (hReader) CloseHandle(hReader);
+    output = std::make_shared<OutputPipe>(hChildOutRead);
+    hChildOutRead = NULL;
+    hReader = CreateThread(NULL, 0, readerMain, new std::shared_ptr<OutputPipe>(output), 0, NULL);
+    return true;
 }
 
 bool ShellSession::isBusy() {
+    if (job) return !job->finished();
     if (hProcess == NULL) return false;
     
     DWORD dwExitCode = 0;
@@ -155,72 +342,415 @@ bool ShellSession::isBusy() {
         if (dwExitCode == STILL_ACTIVE) return true;
     }
     
+    // Let the reader collect what the child wrote right before exiting, so
+    // it is not printed after the next prompt. Grandchildren holding the
+    // pipe open only cost this short wait.
+    if (hReader) {
+        WaitForSingleObject(hReader, 100);
+        CloseHandle(hReader);
+        hReader = NULL;
+    }
     
     cleanupProcess();
     return false;
 }
 
-std::string ShellSession::pollOutput() {
-    if (!hChildOutRead) return "";
+DWORD WINAPI ShellSession::readerMain(LPVOID param) {
+    std::shared_ptr<OutputPipe>* ref = static_cast<std::shared_ptr<OutputPipe>*>(param);
+    std::shared_ptr<OutputPipe> pipe = *ref;
+    delete ref;
 
-    DWORD dwRead, dwAvail, dwLeft;
-    BOOL bSuccess = PeekNamedPipe(hChildOutRead, NULL, 0, NULL, &dwAvail, &dwLeft);
-    
-    if (!bSuccess || dwAvail == 0) return "";
-    
-    std::string result(dwAvail, 0);
-    bSuccess = ReadFile(hChildOutRead, &result[0], dwAvail, &dwRead, NULL);
-    
-    if (!bSuccess || dwRead == 0) return "";
-    
-    if (dwRead < dwAvail) {
-        result.resize(dwRead);
+    char buffer[4096];
+    DWORD dwRead = 0;
+    while (ReadFile(pipe->hRead, buffer, sizeof(buffer), &dwRead, NULL) && dwRead > 0) {
+        EnterCriticalSection(&pipe->lock);
+        pipe->data.append(buffer, dwRead);
+        bool full = pipe->data.size() >= OutputPipe::MAX_BUFFERED;
+        if (full) ResetEvent(pipe->hDrained);
+        LeaveCriticalSection(&pipe->lock);
+        EventLoop::notify();
+
+        if (full) WaitForSingleObject(pipe->hDrained, INFINITE);
     }
+    EventLoop::notify();
+    return 0;
+}
+
+std::string ShellSession::pollOutput(size_t maxBytes) {
+    if (job) return pollJob(maxBytes);
+    if (!output) return "";
+
+    std::string result;
+    EnterCriticalSection(&output->lock);
+    if (output->data.size() <= maxBytes) {
+        result.swap(output->data);
+    } else {
+        result.assign(output->data, 0, maxBytes);
+        output->data.erase(0, maxBytes);
+    }
+    if (output->data.size() < OutputPipe::MAX_BUFFERED) SetEvent(output->hDrained);
+    LeaveCriticalSection(&output->lock);
     return result;
 }
 
 void ShellSession::writeInput(const std::string& input) {
-    if (!hChildInWrite) return;
+    if (job || !hChildInWrite) return;
     
     DWORD dwWritten;
     WriteFile(hChildInWrite, input.data(), input.size(), &dwWritten, NULL);
 }
 
+void ShellSession::interrupt() {
+    if (job) {
+        job->cancel();
+        return;
+    }
+    GenerateConsoleCtrlEvent(CTRL_C_EVENT, 0);
+}
+
+bool ShellSession::echoesInput() const {
+    return job != nullptr; // A job takes no input, so nothing should show
+}
+
+void ShellSession::setWindowSize(int cols, int rows) {
+    // Pipes have no window size; kept for when the session gets a console.
+    winCols = cols;
+    winRows = rows;
+}
+
+EventLoop::Source ShellSession::waitSource() const {
+    return hProcess;
+}
+
+#else
+namespace {
+// Upper bound for what is collected from the pty after the child exits.
+const size_t MAX_TAIL_BYTES = 1024 * 1024;
+
+// The child's environment: ours, with a TERM the pane understands.
+std::vector<std::string> childEnvironment() {
+    std::vector<std::string> env;
+    for (char** e = environ; *e; ++e) {
+        if (strncmp(*e, "TERM=", 5) != 0) env.push_back(*e);
+    }
+    env.push_back("TERM=xterm");
+    return env;
+}
+
+std::vector<char*> pointers(std::vector<std::string>& strings) {
+    std::vector<char*> out;
+    for (auto& s : strings) out.push_back(&s[0]);
+    out.push_back(NULL);
+    return out;
+}
+
+void writeAll(int fd, const std::string& text) {
+    const char* p = text.data();
+    size_t left = text.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        p += n;
+        left -= n;
+    }
+}
+
+}
+
+void ShellSession::readMaster(std::string& out, size_t limit) {
+    char buffer[4096];
+    size_t total = 0;
+    while (total < limit) {
+        ssize_t n = read(masterFd, buffer, std::min(sizeof(buffer), limit - total));
+        if (n > 0) {
+            out.append(buffer, n);
+            total += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            break; // EAGAIN: nothing more for now. EIO: the slave side is closed.
+        }
+    }
+}
+
+void ShellSession::closeMaster() {
+    if (masterFd >= 0) {
+        close(masterFd);
+        masterFd = -1;
+    }
+}
+
+// Forks a child on the slave side of a new pty, in its own session with the
+// pty as controlling terminal and the session directory as cwd, and runs
+// body() there. body must not return and, as it runs between fork() and
+// exec, may only make async-signal-safe calls.
+bool ShellSession::spawnOnPty(const std::function<void()>& body) {
+    if (isBusy()) return false;
+    closeMaster();
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0) return false;
+    const char* slaveName = (grantpt(master) == 0 && unlockpt(master) == 0) ? ptsname(master) : NULL;
+    if (!slaveName) {
+        close(master);
+        return false;
+    }
+    std::string slavePath = slaveName;
+
+    struct winsize ws = {};
+    ws.ws_col = (unsigned short)winCols;
+    ws.ws_row = (unsigned short)winRows;
+    ioctl(master, TIOCSWINSZ, &ws);
+
+    pid_t child = fork();
+    if (child < 0) {
+        close(master);
+        return false;
+    }
+    if (child == 0) {
+        setsid();
+        int slave = open(slavePath.c_str(), O_RDWR);
+        if (slave < 0) _exit(127);
+        ioctl(slave, TIOCSCTTY, 0);
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        if (slave > STDERR_FILENO) close(slave);
+        close(master);
+        if (chdir(currentDirectory.c_str()) != 0) {
+            // Stay in the inherited directory
+        }
+        signal(SIGPIPE, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        body();
+        _exit(127);
+    }
+
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    fcntl(master, F_SETFD, FD_CLOEXEC);
+    masterFd = master;
+    pid = child;
+    return true;
+}
+
+// The pty child acts as a small shell: it forks the stages connected by
+// pipes, waits for all of them and exits like the last one. Data between
+// stages only goes through the pipes; the pane sees the last stage's
+// output (and whatever stderr is not redirected).
+bool ShellSession::execute(const std::vector<PipelineStage>& stages) {
+    if (stages.empty()) return false;
+
+    std::vector<std::string> envStore = childEnvironment();
+    std::vector<char*> envp = pointers(envStore);
+
+    std::vector<std::vector<std::string>> argStore;
+    std::vector<std::vector<char*>> argv;
+    std::vector<std::string> execFailed;
+    std::vector<std::vector<std::string>> openFailed; // Per redirect
+    for (const auto& stage : stages) {
+        argStore.push_back(stage.args);
+        execFailed.push_back("minsh: " + stage.program + ": cannot execute\n");
+        std::vector<std::string> msgs;
+        for (const auto& r : stage.redirects) msgs.push_back("minsh: " + r.path + ": cannot open\n");
+        openFailed.push_back(msgs);
+    }
+    for (auto& a : argStore) argv.push_back(pointers(a));
+    std::vector<pid_t> pids(stages.size(), -1);
+
+    return spawnOnPty([&] {
+        // ^C reaches the whole process group; the stages decide for themselves
+        signal(SIGINT, SIG_IGN);
+        signal(SIGQUIT, SIG_IGN);
+
+        int prevRead = -1;
+        for (size_t k = 0; k < stages.size(); ++k) {
+            int fds[2] = { -1, -1 };
+            if (k + 1 < stages.size() && pipe(fds) != 0) break;
+
+            pid_t c = fork();
+            if (c == 0) {
+                signal(SIGINT, SIG_DFL);
+                signal(SIGQUIT, SIG_DFL);
+                if (prevRead >= 0) {
+                    dup2(prevRead, STDIN_FILENO);
+                    close(prevRead);
+                }
+                if (fds[1] >= 0) {
+                    dup2(fds[1], STDOUT_FILENO);
+                    close(fds[1]);
+                    close(fds[0]);
+                }
+                const auto& redirects = stages[k].redirects;
+                for (size_t r = 0; r < redirects.size(); ++r) {
+                    const Redirect& red = redirects[r];
+                    if (red.dupOf >= 0) {
+                        dup2(red.dupOf, red.fd);
+                        continue;
+                    }
+                    int flags = red.fd == 0 ? O_RDONLY : (O_WRONLY | O_CREAT | (red.append ? O_APPEND : O_TRUNC));
+                    int f = open(red.path.c_str(), flags, 0644);
+                    if (f < 0) {
+                        writeAll(STDERR_FILENO, openFailed[k][r]);
+                        _exit(1);
+                    }
+                    if (f != red.fd) {
+                        dup2(f, red.fd);
+                        close(f);
+                    }
+                }
+                execve(stages[k].program.c_str(), argv[k].data(), envp.data());
+                writeAll(STDERR_FILENO, execFailed[k]);
+                _exit(127);
+            }
+
+            if (prevRead >= 0) close(prevRead);
+            if (fds[1] >= 0) close(fds[1]);
+            prevRead = fds[0];
+            pids[k] = c;
+            if (c < 0) break;
+        }
+        if (prevRead >= 0) close(prevRead);
+
+        int result = 127;
+        for (;;) {
+            int status = 0;
+            pid_t done = waitpid(-1, &status, 0);
+            if (done < 0) {
+                if (errno == EINTR) continue;
+                break; // ECHILD: all reaped
+            }
+            if (done == pids.back()) {
+                result = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            }
+        }
+        _exit(result);
+    });
+}
+
+bool ShellSession::isBusy() {
+    if (!orphans.empty()) reapOrphans();
+    if (job) return !job->finished();
+    if (pid <= 0) return false;
+
+    int status = 0;
+    pid_t r = waitpid(pid, &status, WNOHANG);
+    if (r == 0) return true;
+
+    // Collect what is still buffered in the pty before letting it go, so it
+    // is shown before the next prompt.
+    if (masterFd >= 0) readMaster(tail, MAX_TAIL_BYTES);
+    closeMaster();
+    pid = -1;
+    return false;
+}
+
+std::string ShellSession::pollOutput(size_t maxBytes) {
+    if (job) return pollJob(maxBytes);
+    std::string result;
+    if (tail.size() <= maxBytes) {
+        result.swap(tail);
+    } else {
+        result.assign(tail, 0, maxBytes);
+        tail.erase(0, maxBytes);
+    }
+    if (masterFd >= 0 && result.size() < maxBytes) readMaster(result, maxBytes - result.size());
+    return result;
+}
+
+void ShellSession::writeInput(const std::string& input) {
+    if (job || masterFd < 0) return;
+
+    const char* data = input.data();
+    size_t left = input.size();
+    while (left > 0) {
+        ssize_t n = write(masterFd, data, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += n;
+        left -= (size_t)n;
+    }
+}
+
+void ShellSession::interrupt() {
+    if (job) {
+        job->cancel();
+        return;
+    }
+    // The pty's line discipline turns ^C into SIGINT for the foreground job.
+    writeInput("\x03");
+}
+
+bool ShellSession::echoesInput() const {
+    return true;
+}
+
+void ShellSession::setWindowSize(int cols, int rows) {
+    winCols = cols;
+    winRows = rows;
+    if (masterFd >= 0) {
+        struct winsize ws = {};
+        ws.ws_col = (unsigned short)cols;
+        ws.ws_row = (unsigned short)rows;
+        ioctl(masterFd, TIOCSWINSZ, &ws); // Delivers SIGWINCH to the child
+    }
+}
+
+EventLoop::Source ShellSession::waitSource() const {
+    return masterFd;
+}
+#endif
+
+bool ShellSession::run(std::function<void(Job&)> body) {
+    if (isBusy()) return false;
+    job.reset(new Job(std::move(body)));
+    return true;
+}
+
+// A finished job stays until everything it wrote has been taken, so its
+// last lines come before the next prompt.
+std::string ShellSession::pollJob(size_t maxBytes) {
+    bool over = job->finished();
+    std::string out = job->take(maxBytes);
+    if (over && out.size() < maxBytes) job.reset();
+    return out;
+}
+
 void ShellSession::addHistory(const std::string& cmd) {
-    if (cmd.empty()) return;
-    if (!history.empty() && history.back() == cmd) return;
-    history.push_back(cmd);
+    HistoryStore::add(cmd);
+    HistorySearch::update();
+    HistorySuggest::update();
     historyIndex = -1;
-    saveHistory();
 }
 
 std::string ShellSession::historyUp(const std::string& currentContext) {
-    if (history.empty()) return "";
-    
-    if (historyIndex == -1) {
-        historyIndex = history.size() - 1;
-        tempHistoryInput = currentContext;
-    } else if (historyIndex > 0) {
-        historyIndex--;
-    }
-    
-    if (historyIndex >= 0 && historyIndex < (int)history.size()) {
-        return history[historyIndex];
+    // Skips the empty slots of commands that were run again later
+    int i = (historyIndex == -1) ? (int)HistoryStore::size() : historyIndex;
+    do { i--; } while (i >= 0 && HistoryStore::at(i).empty());
+    if (i < 0) {
+        return historyIndex == -1 ? "" : HistoryStore::at(historyIndex);
     }
-    return "";
+
+    if (historyIndex == -1) tempHistoryInput = currentContext;
+    historyIndex = i;
+    return HistoryStore::at(i);
 }
 
 std::string ShellSession::historyDown() {
     if (historyIndex == -1) return ""; // Already at bottom
-    
-    if (historyIndex < (int)history.size() - 1) {
-        historyIndex++;
-        return history[historyIndex];
-    } else {
-        // Restore temp
-        historyIndex = -1;
-        return tempHistoryInput;
+
+    int i = historyIndex;
+    do { i++; } while (i < (int)HistoryStore::size() && HistoryStore::at(i).empty());
+    if (i < (int)HistoryStore::size()) {
+        historyIndex = i;
+        return HistoryStore::at(i);
     }
+
+    // Restore temp
+    historyIndex = -1;
+    return tempHistoryInput;
 }
 
 void ShellSession::resetHistoryIndex() {
@@ -3,7 +3,17 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <functional>
+#include "EventLoop.hpp"
+#include "Lexer.hpp"
+#include "Job.hpp"
+
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <sys/types.h>
+#endif
 
 class ShellSession {
 public:
@@ -14,17 +24,29 @@ public:
     void setCwd(const std::string& path);
     std::string getCwd() const;
 
-    // Execution
-    bool execute(const std::string& cmd);
-    std::string pollOutput();
+    // Execution: runs the stages connected by pipes, with their redirections
+    // applied; a single command is one stage. Programs must be resolved
+    // already, and arguments reach them as they are (no shell in between).
+    bool execute(const std::vector<PipelineStage>& stages);
+    // Runs a builtin on a Job; the session is busy until it returns and its
+    // output has been polled, and Ctrl+C cancels it.
+    bool run(std::function<void(Job&)> body);
+    // Returns at most maxBytes of pending output; the rest stays with the
+    // child (which blocks once its pipe or pty fills up).
+    std::string pollOutput(size_t maxBytes);
     bool isBusy();
     
-    // Future input support
+    // Input for the running child
     void writeInput(const std::string& input);
+    void interrupt(); // Ctrl+C
+    // True when the child side echoes typed input itself (a pty does).
+    bool echoesInput() const;
+    void setWindowSize(int cols, int rows);
+
+    // Ready while a child runs when it writes or exits; null/-1 when idle.
+    EventLoop::Source waitSource() const;
 
-    // History
-    void initHistory(const std::string& exePath);
-    void saveHistory();
+    // History (shared by all panes, see HistoryStore)
     void addHistory(const std::string& cmd);
     std::string historyUp(const std::string& currentContext);
     std::string historyDown();
@@ -32,14 +54,25 @@ public:
 
 private:
     std::string currentDirectory;
-    std::string historyFilePath;
-    std::vector<std::string> history;
-    int historyIndex = -1;
+    int historyIndex = -1; // HistoryStore slot being shown, -1 when not browsing
     std::string tempHistoryInput; // Preserve current input when moving up
     
+    int winCols = 80;
+    int winRows = 24;
+
+    std::unique_ptr<Job> job;
+    std::string pollJob(size_t maxBytes);
+    
+#ifdef _WIN32
     HANDLE hProcess;
     HANDLE hThread;
     
+    // Output is read by a thread blocking on the pipe, which wakes the
+    // event loop whenever data arrives.
+    struct OutputPipe;
+    std::shared_ptr<OutputPipe> output;
+    HANDLE hReader;
+    
     HANDLE hChildOutRead;
     HANDLE hChildOutWrite;
     HANDLE hChildErrWrite;
@@ -52,6 +85,18 @@ private:
     void createPipes();
     void closePipes();
     void cleanupProcess();
+    static DWORD WINAPI readerMain(LPVOID param);
+#else
+    // The child runs on the slave side of a pseudo-terminal; we keep the
+    // non-blocking master.
+    pid_t pid = -1;
+    int masterFd = -1;
+    std::string tail; // Output collected when the child exited
+
+    void readMaster(std::string& out, size_t limit);
+    void closeMaster();
+    bool spawnOnPty(const std::function<void()>& body);
+#endif
 };
 
 #endif // SHELL_SESSION_HPP
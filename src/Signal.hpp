@@ -1,10 +1,15 @@
 #ifndef SIGNAL_HPP
 #define SIGNAL_HPP
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <signal.h>
+#endif
 #include <iostream>
 
 namespace Signal {
+#ifdef _WIN32
     inline BOOL WINAPI ConsoleCtrlHandler(DWORD dwCtrlType) {
         if (dwCtrlType == CTRL_C_EVENT) {
             std::cout << "^C\n";
@@ -16,6 +21,13 @@ namespace Signal {
     inline void init() {
         SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
     }
+#else
+    inline void init() {
+        // Ctrl+C reaches us as a key in raw mode; a pane whose child is gone
+        // must not kill the shell on write.
+        signal(SIGPIPE, SIG_IGN);
+    }
+#endif
 }
 
 #endif // SIGNAL_HPP
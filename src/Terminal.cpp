@@ -0,0 +1,309 @@
+#include "Terminal.hpp"
+#include <iostream>
+#include <cctype>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#endif
+
+#ifdef _WIN32
+
+Terminal::Terminal() {
+    hIn = GetStdHandle(STD_INPUT_HANDLE);
+}
+
+Terminal::~Terminal() {
+    restoreMode();
+}
+
+void Terminal::enterRawMode() {
+    if (rawMode) return;
+    GetConsoleMode(hIn, &prevMode);
+    if (!SetConsoleMode(hIn, ENABLE_EXTENDED_FLAGS | ENABLE_WINDOW_INPUT | ENABLE_MOUSE_INPUT)) {
+        std::cerr << "Error setting console mode" << std::endl;
+    }
+    rawMode = true;
+}
+
+void Terminal::restoreMode() {
+    if (!rawMode) return;
+    SetConsoleMode(hIn, prevMode);
+    rawMode = false;
+}
+
+void Terminal::getSize(int& cols, int& rows) {
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi)) {
+        cols = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+        rows = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+    } else {
+        cols = 80;
+        rows = 24;
+    }
+}
+
+EventLoop::Source Terminal::inputSource() const {
+    return hIn;
+}
+
+void Terminal::readEvents(std::vector<TermEvent>& out) {
+    DWORD nAvailable = 0;
+    while (GetNumberOfConsoleInputEvents(hIn, &nAvailable) && nAvailable > 0) {
+        INPUT_RECORD ir[128];
+        DWORD nRead = 0;
+        if (!ReadConsoleInput(hIn, ir, 128, &nRead) || nRead == 0) break;
+
+        for (DWORD i = 0; i < nRead; ++i) {
+            TermEvent ev;
+            if (ir[i].EventType == KEY_EVENT) {
+                const KEY_EVENT_RECORD& ker = ir[i].Event.KeyEvent;
+                ev.type = TermEvent::KEY;
+                ev.key.down = ker.bKeyDown != 0;
+                ev.key.ctrl = (ker.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) != 0;
+                ev.key.shift = (ker.dwControlKeyState & SHIFT_PRESSED) != 0;
+                ev.key.ch = ker.uChar.AsciiChar;
+                switch (ker.wVirtualKeyCode) {
+                    case VK_RETURN: ev.key.key = KEY_ENTER; break;
+                    case VK_TAB: ev.key.key = KEY_TAB; break;
+                    case VK_BACK: ev.key.key = KEY_BACKSPACE; break;
+                    case VK_DELETE: ev.key.key = KEY_DELETE; break;
+                    case VK_ESCAPE: ev.key.key = KEY_ESCAPE; break;
+                    case VK_LEFT: ev.key.key = KEY_LEFT; break;
+                    case VK_RIGHT: ev.key.key = KEY_RIGHT; break;
+                    case VK_UP: ev.key.key = KEY_UP; break;
+                    case VK_DOWN: ev.key.key = KEY_DOWN; break;
+                    case VK_HOME: ev.key.key = KEY_HOME; break;
+                    case VK_END: ev.key.key = KEY_END; break;
+                    default: ev.key.key = ker.wVirtualKeyCode; break;
+                }
+            } else if (ir[i].EventType == MOUSE_EVENT) {
+                const MOUSE_EVENT_RECORD& mer = ir[i].Event.MouseEvent;
+                ev.x = mer.dwMousePosition.X;
+                ev.y = mer.dwMousePosition.Y;
+                if (mer.dwEventFlags & MOUSE_WHEELED) {
+                    // High word is delta
+                    ev.type = TermEvent::MOUSE_WHEEL;
+                    ev.delta = (short)(mer.dwButtonState >> 16);
+                } else if (mer.dwButtonState == FROM_LEFT_1ST_BUTTON_PRESSED) {
+                    ev.type = TermEvent::MOUSE_CLICK;
+                } else {
+                    continue;
+                }
+            } else if (ir[i].EventType == WINDOW_BUFFER_SIZE_EVENT) {
+                ev.type = TermEvent::RESIZE;
+            } else {
+                continue;
+            }
+            out.push_back(ev);
+        }
+    }
+}
+
+#else
+
+namespace {
+
+volatile sig_atomic_t resizePending = 0;
+
+void onResize(int) {
+    resizePending = 1;
+    EventLoop::notify();
+}
+
+void writeAll(const char* s) {
+    std::cout << s;
+    std::cout.flush();
+}
+
+// Extracts the numeric parameters of a CSI sequence, e.g. "1;5" -> {1, 5}.
+std::vector<int> csiParams(const std::string& s) {
+    std::vector<int> params;
+    int cur = 0;
+    bool any = false;
+    for (char c : s) {
+        if (isdigit((unsigned char)c)) {
+            cur = cur * 10 + (c - '0');
+            any = true;
+        } else if (c == ';') {
+            params.push_back(any ? cur : 0);
+            cur = 0;
+            any = false;
+        }
+    }
+    if (any) params.push_back(cur);
+    return params;
+}
+
+}
+
+Terminal::Terminal() {}
+
+Terminal::~Terminal() {
+    restoreMode();
+}
+
+void Terminal::enterRawMode() {
+    if (rawMode) return;
+    if (tcgetattr(STDIN_FILENO, &prevMode) != 0) {
+        std::cerr << "Error setting console mode" << std::endl;
+        return;
+    }
+    struct termios raw = prevMode;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cflag |= CS8;
+    raw.c_cc[VMIN] = 0; // read() returns whatever is pending
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+
+    struct sigaction sa = {};
+    sa.sa_handler = onResize;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGWINCH, &sa, NULL);
+
+    writeAll("\033[?1000h\033[?1006h"); // Mouse clicks and wheel, SGR encoded
+    rawMode = true;
+}
+
+void Terminal::restoreMode() {
+    if (!rawMode) return;
+    writeAll("\033[?1006l\033[?1000l");
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &prevMode);
+    rawMode = false;
+}
+
+void Terminal::getSize(int& cols, int& rows) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 && ws.ws_row > 0) {
+        cols = ws.ws_col;
+        rows = ws.ws_row;
+    } else {
+        cols = 80;
+        rows = 24;
+    }
+}
+
+EventLoop::Source Terminal::inputSource() const {
+    return STDIN_FILENO;
+}
+
+void Terminal::readEvents(std::vector<TermEvent>& out) {
+    if (resizePending) {
+        resizePending = 0;
+        TermEvent ev;
+        ev.type = TermEvent::RESIZE;
+        out.push_back(ev);
+    }
+
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
+        pending.append(buf, n);
+    }
+
+    size_t pos = 0;
+    while (pos < pending.size()) {
+        size_t used = decode(pending, pos, out);
+        if (used == 0) break; // Incomplete escape sequence, wait for the rest
+        pos += used;
+    }
+    pending.erase(0, pos);
+}
+
+// Decodes one key or mouse report starting at pos. Returns the bytes used,
+// or 0 if the sequence is not complete yet.
+size_t Terminal::decode(const std::string& buf, size_t pos, std::vector<TermEvent>& out) {
+    unsigned char c = (unsigned char)buf[pos];
+    TermEvent ev;
+    ev.type = TermEvent::KEY;
+    ev.key.ch = (char)c;
+
+    if (c == 0x1B) {
+        // A lone ESC at the end of the input is the Escape key.
+        if (pos + 1 >= buf.size() || (buf[pos + 1] != '[' && buf[pos + 1] != 'O')) {
+            ev.key.key = KEY_ESCAPE;
+            ev.key.seq = "\033";
+            out.push_back(ev);
+            return 1;
+        }
+
+        size_t i = pos + 2;
+        while (i < buf.size() && ((unsigned char)buf[i] < 0x40 || (unsigned char)buf[i] > 0x7E)) i++;
+        if (i >= buf.size()) return 0;
+
+        std::string params = buf.substr(pos + 2, i - pos - 2);
+        char final = buf[i];
+        size_t used = i - pos + 1;
+        std::vector<int> p = csiParams(params);
+        ev.key.ch = 0;
+
+        if (!params.empty() && params[0] == '<') {
+            // SGR mouse report: ESC [ < button ; x ; y (M press | m release)
+            if (p.size() < 3) return used;
+            int button = p[0];
+            ev.x = p[1] - 1;
+            ev.y = p[2] - 1;
+            if (button & 64) {
+                ev.type = TermEvent::MOUSE_WHEEL;
+                ev.delta = (button & 1) ? -120 : 120;
+            } else if (final == 'M' && (button & 3) == 0 && !(button & 32)) {
+                ev.type = TermEvent::MOUSE_CLICK;
+            } else {
+                return used;
+            }
+            out.push_back(ev);
+            return used;
+        }
+
+        if (p.size() >= 2) {
+            int mods = p[1] - 1;
+            ev.key.shift = (mods & 1) != 0;
+            ev.key.ctrl = (mods & 4) != 0;
+        }
+        switch (final) {
+            case 'A': ev.key.key = KEY_UP; break;
+            case 'B': ev.key.key = KEY_DOWN; break;
+            case 'C': ev.key.key = KEY_RIGHT; break;
+            case 'D': ev.key.key = KEY_LEFT; break;
+            case 'H': ev.key.key = KEY_HOME; break;
+            case 'F': ev.key.key = KEY_END; break;
+            case '~':
+                if (!p.empty()) {
+                    if (p[0] == 1 || p[0] == 7) ev.key.key = KEY_HOME;
+                    else if (p[0] == 4 || p[0] == 8) ev.key.key = KEY_END;
+                    else if (p[0] == 3) ev.key.key = KEY_DELETE;
+                }
+                break;
+        }
+        // Keys without a name here (PgUp, Insert, F1...) still go out as
+        // KEY_NONE, for programs running in the pane
+        ev.key.seq = buf.substr(pos, used);
+        out.push_back(ev);
+        return used;
+    }
+
+    if (c == '\r' || c == '\n') {
+        ev.key.key = KEY_ENTER;
+        ev.key.ch = '\r';
+    } else if (c == 0x7F || c == 0x08) {
+        ev.key.key = KEY_BACKSPACE;
+    } else if (c == '\t') {
+        ev.key.key = KEY_TAB;
+    } else if (c >= 0x01 && c <= 0x1A) {
+        ev.key.ctrl = true;
+        ev.key.key = 'A' + c - 1;
+    } else if (c < 0x20) {
+        return 1;
+    } else {
+        ev.key.key = (c < 0x80) ? toupper(c) : KEY_NONE;
+        ev.key.shift = isupper(c) != 0;
+    }
+    ev.key.seq.assign(1, (char)c);
+    out.push_back(ev);
+    return 1;
+}
+
+#endif
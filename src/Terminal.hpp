@@ -0,0 +1,84 @@
+#ifndef TERMINAL_HPP
+#define TERMINAL_HPP
+
+#include <vector>
+#include <string>
+#include "EventLoop.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <termios.h>
+#endif
+
+// Keys that are not plain characters. Letters and digits use their
+// upper-case ASCII code, like Windows virtual keys, so Ctrl+C is key 'C'.
+enum Key {
+    KEY_NONE = 0,
+    KEY_ENTER = 0x100,
+    KEY_TAB,
+    KEY_BACKSPACE,
+    KEY_DELETE,
+    KEY_ESCAPE,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_UP,
+    KEY_DOWN,
+    KEY_HOME,
+    KEY_END
+};
+
+struct KeyEvent {
+    bool down = true;
+    bool ctrl = false;
+    bool shift = false;
+    int key = KEY_NONE;
+    char ch = 0; // Character produced, '\r' for Enter, 0 for none
+    std::string seq; // Bytes as the terminal sent them (POSIX only)
+};
+
+struct TermEvent {
+    enum Type {
+        KEY,
+        MOUSE_CLICK,
+        MOUSE_WHEEL,
+        RESIZE
+    } type = KEY;
+    KeyEvent key;
+    int x = 0;
+    int y = 0;
+    int delta = 0; // Wheel: +120 per notch away from the user, as on Windows
+};
+
+// The controlling console: input mode, size, and input decoded into
+// TermEvents. On Windows this wraps the console input buffer; elsewhere
+// stdin is put in raw mode and escape sequences are decoded here.
+class Terminal {
+public:
+    Terminal();
+    ~Terminal();
+
+    void enterRawMode();
+    void restoreMode();
+
+    static void getSize(int& cols, int& rows);
+
+    // Becomes ready when input is pending.
+    EventLoop::Source inputSource() const;
+    // Appends every event already pending; never blocks.
+    void readEvents(std::vector<TermEvent>& out);
+
+private:
+    bool rawMode = false;
+#ifdef _WIN32
+    HANDLE hIn;
+    DWORD prevMode = 0;
+#else
+    struct termios prevMode;
+    std::string pending; // Bytes of an incomplete escape sequence
+
+    size_t decode(const std::string& buf, size_t pos, std::vector<TermEvent>& out);
+#endif
+};
+
+#endif // TERMINAL_HPP
@@ -0,0 +1,214 @@
+#ifndef VT_PARSER_HPP
+#define VT_PARSER_HPP
+
+#include <cstdint>
+
+// DEC-compatible escape sequence parser after Paul Williams' VT500 state
+// diagram. Every (state, byte) pair is looked up in a transition table that
+// is built at compile time; parameters live in fixed arrays, so feeding a
+// byte never allocates.
+//
+// The parser does not interpret anything. It reports to a handler, which
+// must provide:
+//   void vtPrint(unsigned char c);                           // graphic byte
+//   void vtExecute(unsigned char c);                         // C0 control
+//   void vtEscDispatch(const VtParser& p, unsigned char final);
+//   void vtCsiDispatch(const VtParser& p, unsigned char final);
+// Bytes from 0x80 up are printed (UTF-8 text) rather than read as C1
+// controls. OSC, DCS, SOS, PM and APC strings are consumed and dropped.
+class VtParser {
+public:
+    static const int MAX_PARAMS = 16;
+    static const int MAX_INTERMEDIATES = 2;
+
+    enum State : uint8_t {
+        GROUND,
+        ESCAPE,
+        ESCAPE_INTERMEDIATE,
+        CSI_ENTRY,
+        CSI_PARAM,
+        CSI_INTERMEDIATE,
+        CSI_IGNORE,
+        DCS_ENTRY,
+        DCS_PARAM,
+        DCS_INTERMEDIATE,
+        DCS_PASSTHROUGH,
+        DCS_IGNORE,
+        OSC_STRING,
+        SOS_PM_APC_STRING,
+        STATE_COUNT
+    };
+
+    enum Action : uint8_t {
+        NONE,
+        PRINT,
+        EXECUTE,
+        CLEAR,
+        COLLECT,
+        PARAM,
+        ESC_DISPATCH,
+        CSI_DISPATCH
+    };
+
+    template <class Handler>
+    void advance(Handler& h, unsigned char c);
+
+    bool inGround() const { return state == GROUND; }
+    void reset() { state = GROUND; clear(); }
+
+    // Parameters of the sequence being dispatched. A missing or zero
+    // parameter reads as def, which is how most sequences default.
+    int paramCount() const { return nparams; }
+    int param(int i, int def) const { return (i < nparams && params[i] != 0) ? params[i] : def; }
+
+    // Intermediate bytes, including a private marker such as '?' or '>'.
+    int intermediateCount() const { return ninter; }
+    char intermediate(int i) const { return i < ninter ? inter[i] : 0; }
+
+private:
+    State state = GROUND;
+    int params[MAX_PARAMS] = {};
+    int nparams = 0;
+    char inter[MAX_INTERMEDIATES] = {};
+    int ninter = 0;
+
+    void clear() {
+        nparams = 0;
+        ninter = 0;
+    }
+
+    void collect(unsigned char c) {
+        if (ninter < MAX_INTERMEDIATES) inter[ninter++] = (char)c;
+    }
+
+    void param(unsigned char c) {
+        if (nparams == 0) params[nparams++] = 0;
+        if (c == ';') {
+            if (nparams < MAX_PARAMS) params[nparams++] = 0;
+            return;
+        }
+        int& p = params[nparams - 1];
+        p = p * 10 + (c - '0');
+        if (p > 65535) p = 65535;
+    }
+};
+
+namespace VtTable {
+
+// One byte per transition: action in the high nibble, next state in the low.
+struct Table {
+    uint8_t next[VtParser::STATE_COUNT][256];
+};
+
+constexpr uint8_t to(VtParser::Action action, VtParser::State state) {
+    return (uint8_t)((action << 4) | state);
+}
+
+constexpr void set(Table& t, int state, int lo, int hi, uint8_t transition) {
+    for (int c = lo; c <= hi; ++c) t.next[state][c] = transition;
+}
+
+// C0 controls other than CAN, SUB and ESC, which act from any state.
+constexpr void c0(Table& t, int state, uint8_t transition) {
+    set(t, state, 0x00, 0x17, transition);
+    set(t, state, 0x19, 0x19, transition);
+    set(t, state, 0x1C, 0x1F, transition);
+}
+
+constexpr Table build() {
+    using P = VtParser;
+    Table t{};
+
+    for (int s = 0; s < P::STATE_COUNT; ++s) {
+        // Everything not listed below is ignored without leaving the state.
+        set(t, s, 0x00, 0xFF, to(P::NONE, (P::State)s));
+        set(t, s, 0x18, 0x18, to(P::EXECUTE, P::GROUND));
+        set(t, s, 0x1A, 0x1A, to(P::EXECUTE, P::GROUND));
+        set(t, s, 0x1B, 0x1B, to(P::CLEAR, P::ESCAPE));
+    }
+
+    c0(t, P::GROUND, to(P::EXECUTE, P::GROUND));
+    set(t, P::GROUND, 0x20, 0xFF, to(P::PRINT, P::GROUND));
+
+    c0(t, P::ESCAPE, to(P::EXECUTE, P::ESCAPE));
+    set(t, P::ESCAPE, 0x20, 0x2F, to(P::COLLECT, P::ESCAPE_INTERMEDIATE));
+    set(t, P::ESCAPE, 0x30, 0x7E, to(P::ESC_DISPATCH, P::GROUND));
+    set(t, P::ESCAPE, 'P', 'P', to(P::CLEAR, P::DCS_ENTRY));
+    set(t, P::ESCAPE, 'X', 'X', to(P::NONE, P::SOS_PM_APC_STRING));
+    set(t, P::ESCAPE, '[', '[', to(P::CLEAR, P::CSI_ENTRY));
+    set(t, P::ESCAPE, ']', ']', to(P::NONE, P::OSC_STRING));
+    set(t, P::ESCAPE, '^', '_', to(P::NONE, P::SOS_PM_APC_STRING));
+
+    c0(t, P::ESCAPE_INTERMEDIATE, to(P::EXECUTE, P::ESCAPE_INTERMEDIATE));
+    set(t, P::ESCAPE_INTERMEDIATE, 0x20, 0x2F, to(P::COLLECT, P::ESCAPE_INTERMEDIATE));
+    set(t, P::ESCAPE_INTERMEDIATE, 0x30, 0x7E, to(P::ESC_DISPATCH, P::GROUND));
+
+    c0(t, P::CSI_ENTRY, to(P::EXECUTE, P::CSI_ENTRY));
+    set(t, P::CSI_ENTRY, 0x20, 0x2F, to(P::COLLECT, P::CSI_INTERMEDIATE));
+    set(t, P::CSI_ENTRY, 0x30, 0x39, to(P::PARAM, P::CSI_PARAM));
+    set(t, P::CSI_ENTRY, 0x3A, 0x3A, to(P::NONE, P::CSI_IGNORE));
+    set(t, P::CSI_ENTRY, 0x3B, 0x3B, to(P::PARAM, P::CSI_PARAM));
+    set(t, P::CSI_ENTRY, 0x3C, 0x3F, to(P::COLLECT, P::CSI_PARAM));
+    set(t, P::CSI_ENTRY, 0x40, 0x7E, to(P::CSI_DISPATCH, P::GROUND));
+
+    c0(t, P::CSI_PARAM, to(P::EXECUTE, P::CSI_PARAM));
+    set(t, P::CSI_PARAM, 0x20, 0x2F, to(P::COLLECT, P::CSI_INTERMEDIATE));
+    set(t, P::CSI_PARAM, 0x30, 0x39, to(P::PARAM, P::CSI_PARAM));
+    set(t, P::CSI_PARAM, 0x3A, 0x3A, to(P::NONE, P::CSI_IGNORE));
+    set(t, P::CSI_PARAM, 0x3B, 0x3B, to(P::PARAM, P::CSI_PARAM));
+    set(t, P::CSI_PARAM, 0x3C, 0x3F, to(P::NONE, P::CSI_IGNORE));
+    set(t, P::CSI_PARAM, 0x40, 0x7E, to(P::CSI_DISPATCH, P::GROUND));
+
+    c0(t, P::CSI_INTERMEDIATE, to(P::EXECUTE, P::CSI_INTERMEDIATE));
+    set(t, P::CSI_INTERMEDIATE, 0x20, 0x2F, to(P::COLLECT, P::CSI_INTERMEDIATE));
+    set(t, P::CSI_INTERMEDIATE, 0x30, 0x3F, to(P::NONE, P::CSI_IGNORE));
+    set(t, P::CSI_INTERMEDIATE, 0x40, 0x7E, to(P::CSI_DISPATCH, P::GROUND));
+
+    c0(t, P::CSI_IGNORE, to(P::EXECUTE, P::CSI_IGNORE));
+    set(t, P::CSI_IGNORE, 0x40, 0x7E, to(P::NONE, P::GROUND));
+
+    set(t, P::DCS_ENTRY, 0x20, 0x2F, to(P::COLLECT, P::DCS_INTERMEDIATE));
+    set(t, P::DCS_ENTRY, 0x30, 0x39, to(P::PARAM, P::DCS_PARAM));
+    set(t, P::DCS_ENTRY, 0x3A, 0x3A, to(P::NONE, P::DCS_IGNORE));
+    set(t, P::DCS_ENTRY, 0x3B, 0x3B, to(P::PARAM, P::DCS_PARAM));
+    set(t, P::DCS_ENTRY, 0x3C, 0x3F, to(P::COLLECT, P::DCS_PARAM));
+    set(t, P::DCS_ENTRY, 0x40, 0x7E, to(P::NONE, P::DCS_PASSTHROUGH));
+
+    set(t, P::DCS_PARAM, 0x20, 0x2F, to(P::COLLECT, P::DCS_INTERMEDIATE));
+    set(t, P::DCS_PARAM, 0x30, 0x39, to(P::PARAM, P::DCS_PARAM));
+    set(t, P::DCS_PARAM, 0x3A, 0x3A, to(P::NONE, P::DCS_IGNORE));
+    set(t, P::DCS_PARAM, 0x3B, 0x3B, to(P::PARAM, P::DCS_PARAM));
+    set(t, P::DCS_PARAM, 0x3C, 0x3F, to(P::NONE, P::DCS_IGNORE));
+    set(t, P::DCS_PARAM, 0x40, 0x7E, to(P::NONE, P::DCS_PASSTHROUGH));
+
+    set(t, P::DCS_INTERMEDIATE, 0x20, 0x2F, to(P::COLLECT, P::DCS_INTERMEDIATE));
+    set(t, P::DCS_INTERMEDIATE, 0x30, 0x3F, to(P::NONE, P::DCS_IGNORE));
+    set(t, P::DCS_INTERMEDIATE, 0x40, 0x7E, to(P::NONE, P::DCS_PASSTHROUGH));
+
+    // xterm also ends OSC strings with BEL.
+    set(t, P::OSC_STRING, 0x07, 0x07, to(P::NONE, P::GROUND));
+
+    return t;
+}
+
+inline constexpr Table TRANSITIONS = build();
+
+}
+
+template <class Handler>
+inline void VtParser::advance(Handler& h, unsigned char c) {
+    uint8_t t = VtTable::TRANSITIONS.next[state][c];
+    switch ((Action)(t >> 4)) {
+        case PRINT: h.vtPrint(c); break;
+        case EXECUTE: h.vtExecute(c); break;
+        case CLEAR: clear(); break;
+        case COLLECT: collect(c); break;
+        case PARAM: param(c); break;
+        case ESC_DISPATCH: h.vtEscDispatch(*this, c); break;
+        case CSI_DISPATCH: h.vtCsiDispatch(*this, c); break;
+        case NONE: break;
+    }
+    state = (State)(t & 0x0F);
+}
+
+#endif // VT_PARSER_HPP
@@ -0,0 +1,89 @@
+#ifndef WORK_STEALING_HPP
+#define WORK_STEALING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Items (directories, mostly) processed by a fixed set of threads, where
+// processing one may queue more. Each thread keeps its own deque: it takes
+// its newest item (depth first, warm caches) and, when that runs dry,
+// steals the oldest of another's (the biggest subtrees, so fewer steals).
+template <class Item>
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads) : queues(threads < 1 ? 1 : threads) {}
+
+    unsigned threads() const { return (unsigned)queues.size(); }
+
+    // Queues on thread self's deque; before run(), use 0.
+    void push(unsigned self, Item item) {
+        pending++;
+        std::lock_guard<std::mutex> guard(queues[self].lock);
+        queues[self].items.push_back(std::move(item));
+    }
+
+    // Calls process(self, item) on every thread until everything queued,
+    // including what processing queues, is done or stop() turns true.
+    // idle(self) runs whenever a thread finds nothing to take. The caller
+    // is thread 0.
+    template <class Process, class Idle, class Stop>
+    void run(Process process, Idle idle, Stop stop) {
+        auto work = [&](unsigned self) {
+            Item item;
+            int misses = 0;
+            while (!stop()) {
+                if (next(self, item)) {
+                    misses = 0;
+                    process(self, item);
+                    pending--;
+                    continue;
+                }
+                idle(self);
+                if (pending == 0) break;
+                // Others are still busy and may queue more; back off a
+                // little more each time
+                if (++misses < 64) std::this_thread::yield();
+                else std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        };
+        std::vector<std::thread> pool;
+        for (unsigned i = 1; i < queues.size(); ++i) pool.emplace_back(work, i);
+        work(0);
+        for (auto& t : pool) t.join();
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Item> items;
+    };
+    std::vector<Queue> queues;
+    std::atomic<size_t> pending{0}; // Queued or being processed
+
+    bool next(unsigned self, Item& item) {
+        {
+            std::lock_guard<std::mutex> guard(queues[self].lock);
+            if (!queues[self].items.empty()) {
+                item = std::move(queues[self].items.back());
+                queues[self].items.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); ++k) {
+            Queue& victim = queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.items.empty()) {
+                item = std::move(victim.items.front());
+                victim.items.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif // WORK_STEALING_HPP